@@ -0,0 +1,476 @@
+/*
+ * Microbenchmark of the CPU iteration kernels, without GL, windows or
+ * drivers. Every kernel renders a few fixed views after some warmup runs,
+ * on threads pinned to one CPU each, and the median and fastest of the
+ * repetitions are reported with iterations per nanosecond. With --perf the
+ * hardware counters of the runs are read through perf_event_open. The
+ * threads take bands of rows or blocks along a curve, written into the tile
+ * or one after another with --blocked.
+ *
+ *   bench [--threads N] [--reps N] [--warmup N] [--size N] [--perf]
+ *         [--order bands|rows|morton|hilbert] [--blocked] [--filter TEXT]
+ */
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <wilk/curve.h>
+#include <wilk/formula.h>
+#include <wilk/kernel.h>
+#include <wilk/view.h>
+
+#define MAX_THREADS 64
+#define MAX_REPS 1000
+#define BAND_ROWS 16
+/* --order value for bands of rows, the others are curves. */
+#define ORDER_BANDS CURVE_COUNT
+
+typedef struct {
+  const char *name;
+  uint32_t formula, kernel;
+  const char *custom; /* formula source for FORMULA_CUSTOM */
+} Kernel;
+
+typedef struct {
+  const char *name;
+  double x, y, scale, maxIterations;
+} Points;
+
+/* Add a kernel here when it gets a path of its own in kernel.c. */
+static const Kernel kernels[] = {
+    {"mandelbrot", FORMULA_MANDELBROT, KERNEL_ESCAPE_TIME, NULL},
+    {"ship", FORMULA_BURNING_SHIP, KERNEL_ESCAPE_TIME, NULL},
+    {"tricorn", FORMULA_TRICORN, KERNEL_ESCAPE_TIME, NULL},
+    {"cubic", FORMULA_CUBIC, KERNEL_ESCAPE_TIME, NULL},
+    {"quartic", FORMULA_QUARTIC, KERNEL_ESCAPE_TIME, NULL},
+    {"distance", FORMULA_MANDELBROT, KERNEL_DISTANCE, NULL},
+    {"custom", FORMULA_CUSTOM, KERNEL_ESCAPE_TIME, "z^2 + c"},
+};
+
+static const Points pointSets[] = {
+    {"overview", -0.5, 0.0, 1.0, 1000.0},
+    {"seahorse", -0.745, 0.1, 50.0, 2000.0},
+    {"interior", -0.1, 0.1, 8.0, 5000.0}, /* mostly capped pixels */
+    {"deep", -0.7436438870371587, 0.1318259042053119, 1e10, 4000.0},
+};
+
+/* A pool of pinned threads that render the bands or blocks of one tile per
+ * run. */
+typedef struct {
+  pthread_t threads[MAX_THREADS];
+  unsigned int count;
+  pthread_barrier_t start, done;
+  const TileKey *key;
+  void *out;
+  const uint32_t *order; /* blocks, NULL for bands */
+  uint32_t blocks, columns, next;
+  char blocked, quit;
+} Pool;
+
+typedef struct {
+  Pool *pool;
+  unsigned int index;
+} Worker;
+
+/* Counters of one group, in the order they are opened. */
+enum { PERF_CYCLES, PERF_INSTRUCTIONS, PERF_BRANCH_MISSES, PERF_COUNT };
+
+typedef struct {
+  int fd[PERF_COUNT];
+  char on;
+} Perf;
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The CPU of the index'th thread, out of those we may run on. */
+static void pin(unsigned int index) {
+  cpu_set_t allowed, one;
+  unsigned int seen = 0, cpus = 0;
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed))
+    return;
+  cpus = CPU_COUNT(&allowed);
+  if (!cpus)
+    return;
+
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (!CPU_ISSET(cpu, &allowed) || seen++ != index % cpus)
+      continue;
+
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+    return;
+  }
+}
+
+static void renderBands(Pool *pool) {
+  uint32_t band;
+
+  while ((band = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) *
+             BAND_ROWS <
+         pool->key->height)
+    kernelRender(pool->key, band * BAND_ROWS, BAND_ROWS, pool->out);
+}
+
+static void renderBlocks(Pool *pool) {
+  uint32_t i, block;
+
+  while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) <
+         pool->blocks) {
+    block = pool->order[i];
+    if (pool->blocked)
+      kernelRenderBlock(pool->key, block,
+                        (float *)pool->out +
+                            (size_t)i * KERNEL_BLOCK * KERNEL_BLOCK);
+    else
+      kernelRenderRect(pool->key, block % pool->columns * KERNEL_BLOCK,
+                       block / pool->columns * KERNEL_BLOCK, KERNEL_BLOCK,
+                       KERNEL_BLOCK, pool->out);
+  }
+}
+
+static void render(Pool *pool) {
+  if (pool->order)
+    renderBlocks(pool);
+  else
+    renderBands(pool);
+}
+
+static void *worker(void *arg) {
+  Worker *w = arg;
+  Pool *pool = w->pool;
+
+  pin(w->index);
+  for (;;) {
+    pthread_barrier_wait(&pool->start);
+    if (pool->quit)
+      return NULL;
+    render(pool);
+    pthread_barrier_wait(&pool->done);
+  }
+}
+
+/* The calling thread is worker 0. */
+static void poolStart(Pool *pool, unsigned int count) {
+  static Worker workers[MAX_THREADS];
+
+  memset(pool, 0, sizeof(*pool));
+  pthread_barrier_init(&pool->start, NULL, count);
+  pthread_barrier_init(&pool->done, NULL, count);
+  pin(0);
+
+  for (unsigned int i = 1; i < count; i++) {
+    workers[i].pool = pool;
+    workers[i].index = i;
+    pthread_create(&pool->threads[i], NULL, worker, &workers[i]);
+  }
+  pool->count = count;
+}
+
+static void poolStop(Pool *pool) {
+  pool->quit = 1;
+  pthread_barrier_wait(&pool->start);
+  for (unsigned int i = 1; i < pool->count; i++)
+    pthread_join(pool->threads[i], NULL);
+  pthread_barrier_destroy(&pool->start);
+  pthread_barrier_destroy(&pool->done);
+}
+
+/* Renders the tile on every thread of the pool, returns the seconds. */
+static double poolRun(Pool *pool, const TileKey *key, void *out) {
+  double start;
+
+  pool->key = key;
+  pool->out = out;
+  pool->next = 0;
+
+  start = now();
+  pthread_barrier_wait(&pool->start);
+  render(pool);
+  pthread_barrier_wait(&pool->done);
+  return now() - start;
+}
+
+static void perfClose(Perf *perf) {
+  for (int i = 0; i < PERF_COUNT; i++) {
+    if (perf->fd[i] >= 0)
+      close(perf->fd[i]);
+    perf->fd[i] = -1;
+  }
+}
+
+/* Counts the whole process, so the workers started later count too. */
+static void perfOpen(Perf *perf) {
+  static const uint64_t configs[PERF_COUNT] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_BRANCH_MISSES};
+  struct perf_event_attr attr;
+
+  perf->on = 1;
+  for (int i = 0; i < PERF_COUNT; i++) {
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = configs[i];
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    perf->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (perf->fd[i] < 0)
+      perf->on = 0;
+  }
+
+  if (!perf->on)
+    perfClose(perf);
+}
+
+static void perfEnable(Perf *perf, char enable) {
+  for (int i = 0; perf->on && i < PERF_COUNT; i++) {
+    if (enable)
+      ioctl(perf->fd[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(perf->fd[i], enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE,
+          0);
+  }
+}
+
+/* Inherited counts only add up once the workers are gone, so the pool is
+ * stopped before this. */
+static void perfRead(Perf *perf, uint64_t *counts) {
+  for (int i = 0; i < PERF_COUNT; i++)
+    if (!perf->on || read(perf->fd[i], &counts[i], sizeof(counts[i])) !=
+                         (ssize_t)sizeof(counts[i]))
+      counts[i] = 0;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/* Iterations the escape time kernel runs for the points, the work every
+ * kernel of the formula does short of skipping pixels. */
+static uint64_t countIterations(const TileKey *key, uint32_t *counts) {
+  TileKey escape = *key;
+  uint64_t total = 0;
+
+  escape.kernel = KERNEL_ESCAPE_TIME;
+  escape.format = TILE_FORMAT_U32;
+  kernelRenderParallel(&escape, counts, 8);
+
+  for (size_t i = 0; i < (size_t)key->width * key->height; i++)
+    total += counts[i];
+  return total;
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [options]\n"
+         "  --threads N   pinned render threads (1)\n"
+         "  --reps N      timed repetitions (10)\n"
+         "  --warmup N    untimed runs first (2)\n"
+         "  --size N      pixels on a side (512)\n"
+         "  --perf        read cycles, instructions and branch misses\n"
+         "  --order NAME  bands, rows, morton or hilbert (hilbert)\n"
+         "  --blocked     write blocks one after another, not into the tile\n"
+         "  --filter TEXT only kernels or point sets containing TEXT\n",
+         name);
+}
+
+int main(int argc, char **argv) {
+  static const struct option options[] = {
+      {"threads", required_argument, NULL, 't'},
+      {"reps", required_argument, NULL, 'r'},
+      {"warmup", required_argument, NULL, 'w'},
+      {"size", required_argument, NULL, 's'},
+      {"perf", no_argument, NULL, 'p'},
+      {"order", required_argument, NULL, 'o'},
+      {"blocked", no_argument, NULL, 'b'},
+      {"filter", required_argument, NULL, 'f'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}};
+  unsigned int threads = 1, reps = 10, warmup = 2, size = 512;
+  uint32_t order = CURVE_HILBERT, columns, blocks, *blockOrder = NULL;
+  const char *filter = NULL;
+  char perfWanted = 0, blocked = 0;
+  double times[MAX_REPS];
+  uint32_t *counts;
+  float *out;
+  size_t outSize;
+  int option;
+
+  while ((option = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+    switch (option) {
+    case 't':
+      threads = strtoul(optarg, NULL, 10);
+      break;
+    case 'r':
+      reps = strtoul(optarg, NULL, 10);
+      break;
+    case 'w':
+      warmup = strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      size = strtoul(optarg, NULL, 10);
+      break;
+    case 'p':
+      perfWanted = 1;
+      break;
+    case 'o':
+      for (order = 0; order < ORDER_BANDS; order++)
+        if (strcmp(optarg, curveName(order)) == 0)
+          break;
+      if (order == ORDER_BANDS && strcmp(optarg, "bands") != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'b':
+      blocked = 1;
+      break;
+    case 'f':
+      filter = optarg;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (!threads || threads > MAX_THREADS || !reps || reps > MAX_REPS ||
+      !size || (blocked && order == ORDER_BANDS)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  /* Every tile is size pixels on a side, so are its blocks. */
+  columns = (size + KERNEL_BLOCK - 1) / KERNEL_BLOCK;
+  blocks = columns * columns;
+  outSize = blocked ? (size_t)blocks * KERNEL_BLOCK * KERNEL_BLOCK
+                    : (size_t)size * size;
+
+  out = malloc(outSize * sizeof(*out));
+  counts = malloc((size_t)size * size * sizeof(*counts));
+  if (order != ORDER_BANDS)
+    blockOrder = malloc(blocks * sizeof(*blockOrder));
+  if (!out || !counts || (order != ORDER_BANDS && !blockOrder)) {
+    fputs("Not enough memory\n", stderr);
+    return 1;
+  }
+  if (blockOrder)
+    curveOrder(order, columns, columns, blockOrder);
+
+  /* Containers and perf_event_paranoid often forbid counters. */
+  if (perfWanted) {
+    Perf probe = {{-1, -1, -1}, 0};
+
+    perfOpen(&probe);
+    perfWanted = probe.on;
+    perfClose(&probe);
+    if (!perfWanted)
+      fputs("perf_event_open is not available, no counters\n", stderr);
+  }
+
+  if (order == ORDER_BANDS)
+    puts("Threads take bands of rows");
+  else
+    printf("Threads take blocks in %s order%s\n", curveName(order),
+           blocked ? ", written blocked" : "");
+  printf("%-11s %-9s %7s %9s %9s %9s %7s", "kernel", "points", "threads",
+         "median ms", "min ms", "Mpixel/s", "it/ns");
+  if (perfWanted)
+    printf(" %9s %6s %9s", "cycles/it", "IPC", "br-miss %");
+  putchar('\n');
+
+  for (size_t k = 0; k < sizeof(kernels) / sizeof(*kernels); k++) {
+    const Kernel *kernel = &kernels[k];
+    uint32_t formula = kernel->formula;
+
+    if (kernel->custom && !formulaCompile(kernel->custom, &formula))
+      return 1;
+
+    for (size_t p = 0; p < sizeof(pointSets) / sizeof(*pointSets); p++) {
+      const Points *points = &pointSets[p];
+      View view = {points->x, points->y, points->scale, points->maxIterations,
+                   kernel->kernel, formula, 0, 0.0, 0.0};
+      uint64_t iterations, perfCounts[PERF_COUNT];
+      double median, best;
+      Perf perf = {{-1, -1, -1}, 0};
+      Pool pool;
+      TileKey key;
+
+      if (filter && !strstr(kernel->name, filter) &&
+          !strstr(points->name, filter))
+        continue;
+
+      viewTileKey(&view, size, size, TILE_FORMAT_F32, &key);
+      iterations = countIterations(&key, counts);
+
+      if (perfWanted)
+        perfOpen(&perf);
+
+      poolStart(&pool, threads);
+      pool.order = blockOrder;
+      pool.blocks = blocks;
+      pool.columns = columns;
+      pool.blocked = blocked;
+      for (unsigned int i = 0; i < warmup; i++)
+        poolRun(&pool, &key, out);
+
+      perfEnable(&perf, 1);
+      for (unsigned int i = 0; i < reps; i++)
+        times[i] = poolRun(&pool, &key, out);
+      perfEnable(&perf, 0);
+      poolStop(&pool);
+
+      qsort(times, reps, sizeof(*times), compareDoubles);
+      median = times[reps / 2];
+      best = times[0];
+
+      printf("%-11s %-9s %7u %9.2f %9.2f %9.2f %7.3f", kernel->name,
+             points->name, threads, median * 1e3, best * 1e3,
+             (double)size * size / median * 1e-6,
+             iterations / (median * 1e9));
+
+      if (perf.on) {
+        perfRead(&perf, perfCounts);
+        printf(" %9.2f %6.2f %9.3f",
+               (double)perfCounts[PERF_CYCLES] / (iterations * reps),
+               perfCounts[PERF_CYCLES]
+                   ? (double)perfCounts[PERF_INSTRUCTIONS] /
+                         perfCounts[PERF_CYCLES]
+                   : 0.0,
+               perfCounts[PERF_INSTRUCTIONS]
+                   ? 100.0 * perfCounts[PERF_BRANCH_MISSES] /
+                         perfCounts[PERF_INSTRUCTIONS]
+                   : 0.0);
+        perfClose(&perf);
+      }
+      putchar('\n');
+      fflush(stdout);
+    }
+  }
+
+  free(out);
+  free(counts);
+  free(blockOrder);
+  return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef WILK_ARENA_H
+#define WILK_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump allocator for transient render data (shader sources, decoded and
+ * packed tiles, image rows). Every thread has its own arena, so there is no
+ * locking and no allocator contention between workers.
+ *
+ * Scratch users take a mark and rewind to it when done. Whoever owns a
+ * thread's loop resets its arena at the boundary of a frame, job or tile:
+ * memory that spilled into extra blocks is then merged into one block
+ * large enough for the peak. Once that peak is reached, frames make no
+ * system allocations at all, which debug builds check with
+ * systemAllocations.
+ */
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+  unsigned char *base;
+  size_t size, used;
+  ArenaBlock *blocks;       /* spilled since the last reset, newest first */
+  size_t inUse, peak;       /* bytes, including spilled blocks */
+  size_t systemAllocations; /* mallocs since the last reset */
+} Arena;
+
+typedef struct {
+  size_t used;
+  ArenaBlock *blocks;
+} ArenaMark;
+
+/* The arena of the calling thread, freed when the thread exits. */
+Arena *arenaThread(void);
+
+/* Returns 16 byte aligned memory, NULL when out of memory. */
+void *arenaAlloc(Arena *arena, size_t size);
+
+/* Releases everything allocated after the mark. */
+ArenaMark arenaMark(const Arena *arena);
+void arenaRewind(Arena *arena, ArenaMark mark);
+
+/* Releases everything and keeps one block sized for the peak so far. */
+void arenaReset(Arena *arena);
+void arenaDestroy(Arena *arena);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef WILK_BUDGET_H
+#define WILK_BUDGET_H
+
+/*
+ * Frame time budget. While the view moves, frames are rendered at reduced
+ * detail so that they hold the target frame time: fewer chunk dispatches
+ * per frame first, then a lower internal resolution, then a lower
+ * iteration cap. Once the view stops, detail goes straight back to full
+ * and the spare time goes to finishing the render in more chunks per
+ * frame.
+ */
+
+#define BUDGET_MIN_RESOLUTION 0.25
+#define BUDGET_MIN_ITERATIONS (1.0 / 16.0)
+#define BUDGET_MAX_CHUNKS 64
+
+typedef struct {
+  double target;       /* seconds per frame, 0 for no limit */
+  double average;      /* smoothed frame time */
+  double resolution;   /* fraction of the window per axis */
+  double iterations;   /* fraction of the iteration limit */
+  unsigned int chunks; /* chunk dispatches per frame */
+  unsigned int hold;   /* frames until the average shows the last change */
+} Budget;
+
+void budgetInit(Budget *budget, double target);
+
+/* Adapts to the time the last frame took. */
+void budgetUpdate(Budget *budget, double frameTime, char moving);
+
+#endif
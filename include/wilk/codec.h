@@ -0,0 +1,24 @@
+#ifndef WILK_CODEC_H
+#define WILK_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Run length coding of 16 bit iteration data with 16 bit control words. The
+ * set has large uniform regions (the interior, far field of the distance
+ * kernel) which collapse into a couple of words each. The words are delta
+ * coded first, so the even steps between escape bands also turn into runs.
+ */
+
+/* Largest possible output of codecEncode16 for count words, in bytes. */
+size_t codecBound16(size_t count);
+
+/* Returns the number of bytes written to out. */
+size_t codecEncode16(const uint16_t *in, size_t count, unsigned char *out);
+
+/* Returns 0 if in is malformed or does not hold exactly count words. */
+char codecDecode16(const unsigned char *in, size_t size, uint16_t *out,
+                   size_t count);
+
+#endif
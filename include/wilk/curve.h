@@ -0,0 +1,31 @@
+#ifndef WILK_CURVE_H
+#define WILK_CURVE_H
+
+#include <stdint.h>
+
+/*
+ * Orders for visiting the cells of a grid, such as the blocks of a tile or
+ * the tiles of a farm render. Along a space filling curve consecutive
+ * cells are close on the grid, so work handed out in that order keeps
+ * neighbours, which cost about the same and touch the same data, close
+ * together in time. Hilbert steps to an adjacent cell every time, Morton
+ * (Z order) is cheaper to compute but jumps at the end of every quadrant.
+ */
+
+enum Curve {
+  CURVE_ROWS,    /* row by row, bottom first */
+  CURVE_MORTON,
+  CURVE_HILBERT,
+  CURVE_COUNT
+};
+
+/* Name used by the benchmark, NULL for an unknown curve. */
+const char *curveName(uint32_t curve);
+
+/* Fills order with the columns * rows cells of the grid, each as
+ * y * columns + x, in the order of the curve. Grids of other sizes than a
+ * square power of two follow the curve of the smallest one around them. */
+void curveOrder(uint32_t curve, uint32_t columns, uint32_t rows,
+                uint32_t *order);
+
+#endif
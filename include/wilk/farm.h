@@ -0,0 +1,24 @@
+#ifndef WILK_FARM_H
+#define WILK_FARM_H
+
+#include <wilk/tilestore.h>
+
+/*
+ * Render farm over sockets.
+ *
+ * The coordinator cuts a large render into tiles and hands them to every
+ * worker that connects, a few at a time. Workers render on the CPU and
+ * send the tiles back run length coded, saying they are alive every few
+ * seconds while they render. Tiles of a worker that disconnects or stops
+ * answering go back into the queue.
+ *
+ * Addresses are either unix:<path> or <host>:<port>.
+ */
+
+/* Renders key (TILE_FORMAT_F32) into out. Returns 0 on failure. */
+char farmCoordinate(const char *address, const TileKey *key, float *out);
+
+/* Serves tiles until the coordinator is done. Returns 0 on failure. */
+char farmWork(const char *address);
+
+#endif
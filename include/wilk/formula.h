@@ -0,0 +1,59 @@
+#ifndef WILK_FORMULA_H
+#define WILK_FORMULA_H
+
+#include <stdint.h>
+#include <wilk/jit.h>
+
+/*
+ * Iteration formulas. Each one gets its own shader programs (formula.glsl
+ * is specialised with a #define) and its own CPU kernels (see kernel.c), so
+ * no pixel ever branches on the formula while iterating.
+ *
+ * One custom formula can be loaded at runtime. It is an expression for the
+ * next z in z, c, i, real numbers, + - * /, ^ with a whole power and the
+ * functions conj() and fold() (|re| + |im| i), like
+ *
+ *   fold(z)^2 + c       # burning ship
+ *   z^5 + c / z - 0.2   # and something new
+ *
+ * It becomes GLSL for the shaders and native code (see jit.h) for the CPU.
+ * Custom formulas have no distance estimate.
+ */
+
+/* Values of FORMULA_INDEX(View.formula), keep in sync with formula.glsl. */
+enum Formula {
+  FORMULA_MANDELBROT = 0, /* z^2 + c */
+  FORMULA_BURNING_SHIP,   /* (|x| + i|y|)^2 + c */
+  FORMULA_TRICORN,        /* conj(z)^2 + c */
+  FORMULA_CUBIC,          /* z^3 + c */
+  FORMULA_QUARTIC,        /* z^4 + c */
+  FORMULA_CUSTOM,         /* loaded, a hash of it in the upper 24 bits */
+  FORMULA_COUNT
+};
+
+#define FORMULA_INDEX(formula) ((formula) & 0xff)
+
+/* Longest custom formula source, with its terminating zero. */
+#define FORMULA_MAX_SOURCE 4096
+
+/* Name used on the command line and in job files. */
+const char *formulaName(uint32_t formula);
+
+/* Returns 0 for an unknown name, custom only once one is loaded. */
+char formulaParse(const char *name, uint32_t *formula);
+
+/* The one after formula, for cycling through them. */
+uint32_t formulaNext(uint32_t formula);
+
+/* Replaces the custom formula with the expression in source or in a file.
+ * Returns 0 (with a message) for a bad one. */
+char formulaCompile(const char *source, uint32_t *formula);
+char formulaLoad(const char *path, uint32_t *formula);
+
+/* The GLSL formula(), the CPU loop and the source of a loaded custom
+ * formula, NULL for any other one. */
+const char *formulaGLSL(uint32_t formula);
+FormulaLoop formulaLoop(uint32_t formula);
+const char *formulaSource(uint32_t formula);
+
+#endif
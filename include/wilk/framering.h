@@ -0,0 +1,79 @@
+#ifndef WILK_FRAMERING_H
+#define WILK_FRAMERING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wilk/view.h>
+
+/*
+ * Ring of finished frames in POSIX shared memory for other processes.
+ *
+ * The producer never waits: each slot carries a sequence number that is
+ * odd while the slot is being written. A consumer reads the latest
+ * published sequence, uses the pixels of that slot in place and checks
+ * afterwards that the slot sequence did not change underneath it.
+ * Sequence numbers are accessed atomically (acquire/release).
+ */
+
+#define FRAME_RING_MAGIC 0x474e5257 /* "WRNG" */
+#define FRAME_RING_VERSION 3
+
+/* Both headers fill whole cache lines, so slots and pixels stay aligned. */
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slots;
+  uint32_t maxWidth, maxHeight;
+  uint32_t reserved[7];
+  uint64_t slotSize;  /* FrameHeader plus pixels */
+  uint64_t published; /* sequence of the latest complete frame, 0 if none */
+} FrameRingHeader;
+
+typedef struct {
+  uint64_t sequence; /* 2 * n - 1 while frame n is written, 2 * n after */
+  uint64_t timestamp; /* CLOCK_REALTIME in nanoseconds */
+  uint32_t width, height;
+  uint32_t stride;    /* bytes per row */
+  uint32_t kernel;    /* enum Kernel */
+  double x, y, scale, maxIterations;
+  uint32_t formula; /* enum Formula, see formula.h */
+  uint32_t julia;   /* pixels iterated with a fixed c of (cx, cy) */
+  double cx, cy;
+  uint64_t reserved[5];
+  /* RGBA8 pixels follow, bottom row first. */
+} FrameHeader;
+
+/* Frame n lives in slot n % slots. */
+#define FRAME_RING_SLOT(header, n)                                             \
+  ((FrameHeader *)((unsigned char *)(header) + sizeof(FrameRingHeader) +       \
+                   ((n) % (header)->slots) * (header)->slotSize))
+
+typedef struct FrameRing FrameRing;
+
+/* A ring opened by a consumer. */
+typedef struct {
+  const FrameRingHeader *header;
+  size_t size; /* bytes mapped */
+} FrameRingMap;
+
+/* Producer */
+FrameRing *frameRingCreate(const char *name, uint32_t maxWidth,
+                           uint32_t maxHeight, uint32_t slots);
+void frameRingDestroy(FrameRing *ring);
+
+/* Pixel memory for the next frame, NULL if width x height does not fit. */
+void *frameRingBegin(FrameRing *ring, uint32_t width, uint32_t height);
+void frameRingPublish(FrameRing *ring, const View *view);
+
+/* Consumer */
+char frameRingOpen(const char *name, FrameRingMap *map);
+void frameRingClose(FrameRingMap *map);
+
+/* Latest frame or NULL. The pixels stay valid while frameRingValid() says
+ * so, copy or finish using them and check once more afterwards. */
+const FrameHeader *frameRingLatest(const FrameRingHeader *header,
+                                   uint64_t *sequence);
+char frameRingValid(const FrameHeader *frame, uint64_t sequence);
+
+#endif
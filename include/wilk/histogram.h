@@ -0,0 +1,41 @@
+#ifndef WILK_HISTOGRAM_H
+#define WILK_HISTOGRAM_H
+
+#include <glad/gl.h>
+#include <stdint.h>
+
+/* Keep in sync with BINS in histogram.comp, cdf.comp and colour.frag. */
+#define HISTOGRAM_BINS 4096
+
+/*
+ * Histogram equalised colouring. The histogram of an iteration texture is
+ * counted and turned into a CDF texture with two compute passes, nothing is
+ * read back to the CPU.
+ */
+typedef struct {
+  GLuint histogramProgram, cdfProgram;
+  GLuint bins; /* shader storage buffer of HISTOGRAM_BINS counts */
+  GLuint cdf;  /* 1D R32F texture */
+
+  /* Copy of the bins on its way back to the CPU. */
+  GLuint stats;
+  GLsync statsFence;
+} Histogram;
+
+char histogramInit(Histogram *histogram);
+void histogramDestroy(Histogram *histogram);
+
+/* Rebuilds the CDF from the bottom left width x height pixels of the
+ * iteration texture. */
+void histogramUpdate(Histogram *histogram, GLuint iterations, GLuint width,
+                     GLuint height, double maxIterations);
+
+/* Starts copying the bins of the last update back to the CPU. Returns 0
+ * while an earlier copy is still pending. */
+char histogramRequest(Histogram *histogram);
+
+/* Fills bins with HISTOGRAM_BINS counts once the requested copy is done,
+ * returns 0 without blocking until then. */
+char histogramCollect(Histogram *histogram, uint32_t *bins);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef WILK_IMAGE_H
+#define WILK_IMAGE_H
+
+#include <stdio.h>
+#include <wilk/tilestore.h>
+
+/* Colours F32 tile data like colour.frag does and writes it as a binary
+ * PPM. Returns 0 on failure. */
+char imageWritePPM(const char *path, const TileKey *key, const float *data);
+
+/* Appends RGBA8 pixels, bottom row first, as one binary PPM to fp. A
+ * sequence of them is a stream ffmpeg reads with -f image2pipe. */
+char imageWriteFrame(FILE *fp, uint32_t width, uint32_t height,
+                     const unsigned char *pixels);
+char imageWriteRGBA(const char *path, uint32_t width, uint32_t height,
+                    const unsigned char *pixels);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef WILK_JIT_H
+#define WILK_JIT_H
+
+#include <stdint.h>
+
+/*
+ * Native code for custom formulas. formula.c lowers an expression to a
+ * short list of complex operations, which is turned into a complete
+ * escape time loop for x86-64 with SSE2. Elsewhere, or when a formula
+ * needs more registers than there are, formula.c interprets the list.
+ */
+
+/* Value 0 is z, 1 is c and operation i defines value i + 2. */
+enum FormulaOpKind {
+  OP_CONST, /* re + im i */
+  OP_ADD,   /* a + b */
+  OP_SUB,   /* a - b */
+  OP_MUL,   /* a * b */
+  OP_DIV,   /* a / b */
+  OP_SQR,   /* a * a */
+  OP_SCALE, /* a * re */
+  OP_NEG,   /* -a */
+  OP_CONJ,  /* re(a) - im(a) i */
+  OP_FOLD   /* |re(a)| + |im(a)| i */
+};
+
+typedef struct {
+  uint8_t kind, a, b;
+  double re, im;
+} FormulaOp;
+
+/* Iterates z <- f(z, c) from z until |z| > 2 or limit iterations, returns
+ * the iteration count like escapeTime() in kernel.c. */
+typedef uint32_t (*FormulaLoop)(double zx, double zy, double cx, double cy,
+                                uint32_t limit);
+
+/* The last value of ops is the next z. Returns NULL if this machine or the
+ * formula is not supported. */
+FormulaLoop jitCompile(const FormulaOp *ops, unsigned int count);
+void jitFree(FormulaLoop loop);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef WILK_JOB_H
+#define WILK_JOB_H
+
+#include <limits.h>
+#include <stdint.h>
+#include <wilk/view.h>
+
+/*
+ * Batch renders. A job file has one render per line made of key=value
+ * words, every line starts from the view given on the command line:
+ *
+ *   # centre      zoom        limit          resolution  output
+ *   center=-0.75,0 scale=1    iterations=500 size=1920x1080 output=a.ppm
+ *   center=-0.7436,0.1318 scale=2e4 iterations=2000 output=b.ppm distance
+ *   julia=-0.8,0.156 sweep=-0.7,0.3 frames=120 output=c.ppm
+ *
+ * Known words are center=X,Y, scale=S, iterations=N or iterations=auto,
+ * size=WxH, output=PATH, distance, equalize, formula=NAME (see formula.h)
+ * and julia=X,Y for the Julia set of c = X + Yi. sweep=X,Y with frames=N moves c to X,Y in N frames,
+ * written to PATH with the frame number before the extension. '#' starts
+ * a comment.
+ */
+typedef struct {
+  View view;
+  uint32_t width, height;
+  char equalize;
+  char autoIterations; /* limit from the scale, see limit.h */
+  char output[PATH_MAX];
+  double sweepX, sweepY; /* c of the last frame */
+  uint32_t frames;       /* 0 for a single render */
+} Job;
+
+/* Parses one line over job, which holds the defaults. Returns 1 for a
+ * job, 0 for an empty line and -1 (with a message) for a bad one. */
+int jobParse(char *line, Job *job);
+
+/* The single render for frame [0, job->frames) of a sweep. Returns 0 if
+ * the output path gets too long. */
+char jobFrame(const Job *job, uint32_t frame, Job *out);
+
+#endif
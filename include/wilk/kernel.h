@@ -0,0 +1,59 @@
+#ifndef WILK_KERNEL_H
+#define WILK_KERNEL_H
+
+#include <stdint.h>
+#include <wilk/tilestore.h>
+
+/* Values of TileKey.kernel. */
+enum Kernel {
+  KERNEL_ESCAPE_TIME = 1, /* plain escape time, same as wilk.frag */
+  KERNEL_DISTANCE = 2     /* distance to the set in pixels, 0 inside */
+};
+
+/* Distances beyond this many pixels all get the same colour, keep in sync
+ * with FAR in colour.frag. */
+#define DISTANCE_FAR 8.0
+
+/* Returns 0 for a tile of a custom formula other than the one loaded in
+ * this process (see formula.h), which renders as zeros. */
+char kernelSupports(const TileKey *key);
+
+/* Renders rows [row, row + rows) of the tile described by key into out,
+ * which holds the whole tile in key->format. */
+void kernelRender(const TileKey *key, uint32_t row, uint32_t rows, void *out);
+
+/* The same for the pixels [x, x + width) x [y, y + height). Far distances
+ * depend on where blocks of 8 pixels start, keep x and y multiples of 8 for
+ * the same values as a whole tile. */
+void kernelRenderRect(const TileKey *key, uint32_t x, uint32_t y,
+                      uint32_t width, uint32_t height, void *out);
+
+/* Tiles are rendered in square blocks of this many pixels on a side, a
+ * multiple of the blocks the distance kernel fills at once. */
+#define KERNEL_BLOCK 32
+
+/* Number of blocks of a tile and how many of them make a row. */
+uint32_t kernelBlockCount(const TileKey *key, uint32_t *columns);
+
+/* Renders block number block, counted row by row, into KERNEL_BLOCK^2
+ * values at out with a stride of KERNEL_BLOCK. */
+void kernelRenderBlock(const TileKey *key, uint32_t block, void *out);
+
+/* Renders the whole tile with the given threads, which take its blocks in
+ * the order of a curve (see curve.h). Blocked output holds the blocks one
+ * after another in that order instead of the tile, KERNEL_BLOCK^2 values
+ * each, row by row and padded where they stick out of the tile. The
+ * values are the same in any order. Returns 0, with nothing rendered, for
+ * keys kernelSupports() refuses or without memory for the order. */
+char kernelRenderBlocks(const TileKey *key, void *out, unsigned int threads,
+                        uint32_t curve, char blocked);
+
+/* Blocks along a Hilbert curve into the tile. Returns 0, with nothing
+ * rendered, for keys kernelSupports() refuses. */
+char kernelRenderParallel(const TileKey *key, void *out, unsigned int threads);
+
+/* Copies blocked output of the curve into the layout of the tile. */
+char kernelUnblock(const TileKey *key, uint32_t curve, const void *blocked,
+                   void *out);
+
+#endif
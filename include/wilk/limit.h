@@ -0,0 +1,24 @@
+#ifndef WILK_LIMIT_H
+#define WILK_LIMIT_H
+
+#include <stdint.h>
+
+/*
+ * Automatic iteration limit. The limit grows with the zoom depth and is
+ * corrected by what the histogram of the last frames shows: raised while
+ * pixels still escape just below the cap or most of them hit it, lowered
+ * while the highest escaping pixel is far below it.
+ */
+typedef struct {
+  double bias; /* log2 of the correction to the depth based limit */
+} IterationLimit;
+
+/* The limit for a view at this scale. */
+double limitFor(const IterationLimit *limit, double scale);
+
+/* Learns from the HISTOGRAM_BINS counts of a frame rendered with
+ * maxIterations at scale. Returns 1 if the limit changed. */
+char limitFeedback(IterationLimit *limit, const uint32_t *bins,
+                   double maxIterations, double scale);
+
+#endif
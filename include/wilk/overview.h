@@ -0,0 +1,55 @@
+#ifndef WILK_OVERVIEW_H
+#define WILK_OVERVIEW_H
+
+#include <glad/gl.h>
+#include <stdint.h>
+#include <wilk/renderer.h>
+#include <wilk/tilestore.h>
+#include <wilk/view.h>
+
+/*
+ * Picture in picture overview of the whole set with the shown part of a
+ * view outlined on it, so deep zooms keep their bearings.
+ *
+ * The picture is a small tile rendered on the CPU into the tile store the
+ * first time and from there on later, and coloured into a texture. It is
+ * made at startup and again whenever a window moves on to another formula
+ * or Julia set. A frame only blits that texture into a corner and clears
+ * the four edges of the outline.
+ */
+
+/* Pixels on a side of the picture. */
+#define OVERVIEW_SIZE 256
+
+/* Shared by the windows of a share group that show the same set. */
+typedef struct {
+  GLuint texture; /* RGBA8 */
+  View view;      /* what it shows */
+  unsigned int users;
+} OverviewPicture;
+
+typedef struct {
+  OverviewPicture *picture; /* NULL without one */
+  GLuint fbo;               /* reads the texture, one per context */
+} Overview;
+
+/* Renders and colours the picture of the set of view, leaving the target
+ * of renderer at the size of the picture. Returns 0 without a picture. */
+char overviewInit(Overview *overview, Renderer *renderer, TileStore *store,
+                  const View *view);
+
+/* Makes a new picture when shown is of another set than the one there is,
+ * the same way. Returns 1 if it did, and so used the target of renderer. */
+char overviewUpdate(Overview *overview, Renderer *renderer, TileStore *store,
+                    const View *shown);
+
+/* The same picture for another context of the share group. */
+void overviewShare(Overview *overview, const Overview *from);
+void overviewDestroy(Overview *overview);
+
+/* Draws into the top right corner of the bound draw framebuffer of the
+ * given size, nothing when shown is of another set than the picture. */
+void overviewDraw(const Overview *overview, const View *shown, uint32_t width,
+                  uint32_t height);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef WILK_PACK_H
+#define WILK_PACK_H
+
+#include <stddef.h>
+#include <wilk/tilestore.h>
+
+/*
+ * Compact tile data. F32 tiles are cut to 16 bits per pixel, then delta and
+ * run length coded (see codec.h):
+ *
+ * - escape time counts stay exact, the cap is stored as 0xffff and the few
+ *   counts from 0xfffe up go to a sparse overflow table;
+ * - everything else, like distances, is quantised to a fraction of the
+ *   range colour.frag tells apart (maxIterations or DISTANCE_FAR).
+ *
+ * This is what the tile store keeps as TILE_FORMAT_PACKED and what farm
+ * workers send back.
+ */
+
+/* Largest packed size of a tile. */
+size_t packBound(const TileKey *key);
+
+/* Packs F32 data of the tile described by key, whatever its format says.
+ * Returns the number of bytes written to out, 0 without memory. */
+size_t packEncode(const TileKey *key, const float *in, unsigned char *out);
+
+/* Returns 0 if in does not hold a packed tile for key. */
+char packDecode(const TileKey *key, const unsigned char *in, size_t size,
+                float *out);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef WILK_PREFETCH_H
+#define WILK_PREFETCH_H
+
+#include <stdint.h>
+#include <wilk/limit.h>
+#include <wilk/tilestore.h>
+#include <wilk/view.h>
+
+/*
+ * Background renderer for the views the user is heading toward.
+ *
+ * Recent motions are used to predict the next few views, which idle
+ * priority threads render on the CPU into the tile store. The render loop
+ * picks them up from there instead of running the shader.
+ */
+
+typedef struct Prefetcher Prefetcher;
+
+Prefetcher *prefetchStart(TileStore *store, unsigned int threads);
+void prefetchStop(Prefetcher *prefetcher);
+
+/* Records a navigation step, call it whenever the view moves. */
+void prefetchMotion(Prefetcher *prefetcher, const Motion *motion);
+
+/* Predicted views get their iteration limit from limit, as the views on
+ * screen do, or keep the one they are predicted from for NULL. Call it
+ * whenever the automatic limit changes. */
+void prefetchLimit(Prefetcher *prefetcher, const IterationLimit *limit);
+
+/* Updates the predictions for the view currently on screen. */
+void prefetchObserve(Prefetcher *prefetcher, const View *view, uint32_t width,
+                     uint32_t height);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef WILK_READBACK_H
+#define WILK_READBACK_H
+
+#include <glad/gl.h>
+#include <stdint.h>
+#include <wilk/view.h>
+
+/*
+ * Asynchronous readback of finished frames.
+ *
+ * Frames are copied into one of three pixel buffer objects behind a fence,
+ * and handed to the consumer once the GPU got there. Frame N is mapped
+ * while N + 1 and N + 2 are still in flight, so capturing does not wait
+ * for the GPU to drain.
+ */
+
+#define READBACK_BUFFERS 3
+
+/* Called with the RGBA8 pixels of a frame, bottom row first. targets is
+ * whatever was passed to readbackStart(). */
+typedef void (*ReadbackConsumer)(const void *pixels, uint32_t width,
+                                 uint32_t height, const View *view,
+                                 unsigned int targets);
+
+typedef struct {
+  GLuint buffers[READBACK_BUFFERS];
+  GLsync fences[READBACK_BUFFERS];
+  size_t capacity[READBACK_BUFFERS];
+  uint32_t width[READBACK_BUFFERS], height[READBACK_BUFFERS];
+  View view[READBACK_BUFFERS];
+  unsigned int targets[READBACK_BUFFERS];
+  unsigned int head, pending;
+  ReadbackConsumer consumer;
+} Readback;
+
+void readbackInit(Readback *readback, ReadbackConsumer consumer);
+void readbackDestroy(Readback *readback);
+
+/* Queues a copy of the read framebuffer. With all buffers in flight it
+ * waits for the oldest if wait is set, else the frame is dropped and 0
+ * returned. */
+char readbackStart(Readback *readback, uint32_t width, uint32_t height,
+                   const View *view, unsigned int targets, char wait);
+
+/* Hands finished frames to the consumer, oldest first. Waits for all of
+ * them if wait is set. */
+void readbackPoll(Readback *readback, char wait);
+
+#endif
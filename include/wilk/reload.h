@@ -0,0 +1,33 @@
+#ifndef WILK_RELOAD_H
+#define WILK_RELOAD_H
+
+#include <wilk/renderer.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+/*
+ * Hot reloading of the shaders while tuning them.
+ *
+ * inotify reports every shader source written in the watched directory.
+ * A worker thread then builds all the programs in use again, on a hidden
+ * window of its own whose context shares with the ones rendering, so
+ * frames never wait for the compiler. The new programs replace the old
+ * ones between two frames, once all of them built and the GPU is done
+ * with them. A broken edit prints the compile or link log and leaves the
+ * running programs alone.
+ */
+
+typedef struct Reloader Reloader;
+
+/* Watches dir for the programs, window is a hidden window that shares
+ * with their contexts and is handed to the worker. Returns NULL (with a
+ * message) if the directory cannot be watched. */
+Reloader *reloadStart(const char *dir, GLFWwindow *window,
+                      Programs *programs);
+void reloadStop(Reloader *reloader);
+
+/* Called once per frame by the thread that renders, never blocks. Returns
+ * 1 when new programs are in place and views should render again. */
+char reloadPoll(Reloader *reloader);
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef WILK_RENDERER_H
+#define WILK_RENDERER_H
+
+#include <glad/gl.h>
+#include <stdint.h>
+#include <wilk/formula.h>
+#include <wilk/histogram.h>
+#include <wilk/stats.h>
+#include <wilk/tilestore.h>
+#include <wilk/view.h>
+
+/*
+ * The GL side of a frame: iteration counts go into an offscreen target,
+ * either rendered by wilk.frag or uploaded from the tile store, and are
+ * then coloured into whatever framebuffer is bound. One renderer is
+ * shared by every frame and batch job of a process, so the programs are
+ * compiled once. Rendering programs are specialised per formula and built
+ * the first time a view uses it.
+ *
+ * With compute shaders a view is rendered in chunks of at most
+ * chunkIterations per pixel, so no single dispatch runs long enough to
+ * trip the driver watchdog. The orbits live in images between chunks and
+ * the result goes to a second target, which replaces the shown one when
+ * every pixel is done.
+ *
+ * A render may have less detail than its view asks for (see budget.h): it
+ * then covers only the bottom left width x height pixels of the target and
+ * stops at a lower iteration limit, and is stretched over the screen when
+ * coloured.
+ */
+
+/* Iterations per pixel and dispatch unless changed. */
+#define RENDERER_CHUNK 1024
+
+/* How a render smaller than the screen is stretched over it. */
+typedef enum {
+  UPSCALE_EDGE,    /* bilinear that keeps the set boundary sharp */
+  UPSCALE_BILINEAR
+} Upscale;
+
+typedef struct {
+  uint32_t width, height; /* pixels rendered, at most the target size */
+  double maxIterations;   /* at most the limit of the view */
+} Detail;
+
+/* The programs of a share group, freed with their last renderer. */
+typedef struct {
+  GLuint wilk[FORMULA_COUNT];  /* wilk.frag */
+  GLuint chunk[FORMULA_COUNT]; /* chunk.comp */
+  GLuint colour;
+  uint32_t built;  /* programs tried, a bit per formula and kind */
+  uint32_t custom; /* the custom formula built, see formula.h */
+  unsigned int users;
+} Programs;
+
+/* Bit of colour.frag in the masks below, formulas take the ones under it
+ * like in Programs.built. */
+#define PROGRAMS_COLOUR (1u << (2 * FORMULA_COUNT))
+
+typedef struct {
+  GLuint vbo, ebo, vao;
+  Programs *programs;
+  GLuint fbo, target; /* R32F iteration counts */
+  uint32_t width, height;
+  Detail detail; /* of what is in target */
+  Histogram histogram; /* zero without compute shaders */
+  Stats stats;         /* likewise */
+  Upscale upscale;
+  char heatmap; /* colour by iterations spent instead, see colour.frag */
+
+  /* Chunked rendering, chunked is zero without compute shaders. */
+  char chunked;
+  GLuint next;                    /* R32F, becomes target when done */
+  GLuint orbit, derivative;       /* RGBA32UI, two packed doubles */
+  GLuint progress;                /* R32UI iterations and a done bit */
+  char hasDerivative;
+  uint32_t chunkIterations;       /* 0 renders in one pass */
+  uint32_t chunk, chunks;
+  View pending;
+  Detail pendingDetail;
+  char busy;
+} Renderer;
+
+/* Needs a current context. With share, a renderer of a context sharing
+ * objects with the current one, its programs are reused. Returns 0 if the
+ * shaders do not build. */
+char rendererInit(Renderer *renderer, Renderer *share);
+void rendererDestroy(Renderer *renderer);
+
+/* (Re)allocates the target, returns 1 if its size changed. */
+char rendererResize(Renderer *renderer, uint32_t width, uint32_t height);
+
+/* Fills the target from the tile store, 0 if it does not have the view. */
+char rendererUpload(Renderer *renderer, TileStore *store, const View *view);
+
+/* Renders the view into the target on the GPU and waits for it. */
+void rendererIterate(Renderer *renderer, const View *view);
+
+/* Starts a chunked render of the view, replacing an unfinished one. Falls
+ * back to rendererIterate() without compute shaders. A NULL detail means
+ * all of it. */
+void rendererBegin(Renderer *renderer, const View *view,
+                   const Detail *detail);
+
+/* Full detail for a view at the target size. */
+void rendererFullDetail(const Renderer *renderer, const View *view,
+                        Detail *detail);
+
+/* Runs the next chunk of the pending view. Returns 1 once it is done and
+ * in the target. */
+char rendererContinue(Renderer *renderer);
+
+/* Rebuilds the histogram for the target, rendered is the view in it. */
+void rendererEqualize(Renderer *renderer, const View *rendered);
+
+/* The programs that built, as a mask. */
+uint32_t rendererLivePrograms(const Programs *programs);
+
+/* Builds the programs in mask from the sources as they are now into fresh,
+ * with fresh->built set to mask. Works on any thread with a context of the
+ * share group of programs current, and only reads programs->custom.
+ * Returns 0, with nothing left built, if any of them fails. */
+char rendererBuildPrograms(const Programs *programs, uint32_t mask,
+                           Programs *fresh);
+
+/* Replaces the programs of fresh->built with the ones of fresh and deletes
+ * the old ones. Uniforms are looked up on every use, so the next frame
+ * just uses them. */
+void rendererSwapPrograms(Programs *programs, const Programs *fresh);
+
+/* Starts counting the iterations spent on the target, see stats.h.
+ * Returns 0 if it is not counted. */
+char rendererMeasure(Renderer *renderer, const View *rendered);
+
+/* Colours the target into the bound draw framebuffer of the given size,
+ * rescaled from the rendered view to the shown one. */
+void rendererColour(Renderer *renderer, const View *rendered,
+                    const View *shown, uint32_t width, uint32_t height,
+                    char equalize);
+
+/* Same with the target, detail and histogram of source, a renderer of the
+ * same share group whose last render is complete (see zoomCovers()). */
+void rendererColourFrom(Renderer *renderer, const Renderer *source,
+                        const View *rendered, const View *shown,
+                        uint32_t width, uint32_t height, char equalize);
+
+#endif
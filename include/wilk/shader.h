@@ -0,0 +1,21 @@
+#ifndef WILK_SHADER_H
+#define WILK_SHADER_H
+
+#include <glad/gl.h>
+
+/* Reads a whole file into the arena of the calling thread. */
+const char *readFile(const char *path);
+char checkLinkError(GLuint idx);
+char checkShaderCompileError(GLuint idx);
+
+/* Compiles and links a program from two source files, 0 on failure. */
+GLuint shaderProgram(const char *vertexPath, const char *fragmentPath);
+GLuint computeProgram(const char *path);
+
+/* The same with prelude placed right after the #version line of the
+ * fragment or compute shader, for #defines and shared functions. */
+GLuint shaderProgramWith(const char *vertexPath, const char *fragmentPath,
+                         const char *prelude);
+GLuint computeProgramWith(const char *path, const char *prelude);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef WILK_STATS_H
+#define WILK_STATS_H
+
+#include <glad/gl.h>
+#include <stdint.h>
+
+/*
+ * Where the iteration budget of a render goes. One compute pass reduces an
+ * iteration texture to a few totals in a storage buffer, in shared memory
+ * per work group and then with one atomic per group and total. Like the
+ * histogram the totals come back to the CPU a frame or two later without
+ * stalling anything.
+ */
+
+typedef struct {
+  uint64_t iterations; /* executed, pixels that never escaped count the limit */
+  uint32_t escaped, capped;
+  uint32_t max;        /* most iterations of an escaped pixel */
+  double mean;         /* iterations per pixel */
+} IterationStats;
+
+typedef struct {
+  GLuint program;
+  GLuint totals; /* shader storage buffer, see stats.comp */
+  GLuint copy;   /* of the totals on their way back */
+  GLsync fence;
+} Stats;
+
+char statsInit(Stats *stats);
+void statsDestroy(Stats *stats);
+
+/* Counts the bottom left width x height pixels of the iteration texture,
+ * rendered with the given limit, and starts copying the totals back.
+ * Returns 0, counting nothing, while an earlier copy is still pending. */
+char statsMeasure(Stats *stats, GLuint iterations, GLuint width,
+                  GLuint height, double maxIterations);
+
+/* Fills out once the copy is done, returns 0 without blocking until then. */
+char statsCollect(Stats *stats, IterationStats *out);
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef WILK_TILESTORE_H
+#define WILK_TILESTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * On-disk store for computed iteration tiles.
+ *
+ * A store is a directory holding one file per tile plus an index of
+ * fixed-size entries. Tiles are only ever replaced through rename(2), new
+ * entries are appended to the index under a lock and check themselves, so
+ * any number of wilk processes can read the store while another one
+ * writes. Each process looks entries up in a hash table of its own. Tile
+ * data is handed out straight from a read-only mapping.
+ *
+ * Once the tiles take more than the capacity of the store, the oldest ones
+ * are evicted and the index is rewritten without them.
+ */
+
+/* Default capacity in bytes. */
+#define TILE_STORE_CAPACITY (1024ULL << 20)
+
+enum TileFormat {
+  TILE_FORMAT_U32 = 1, /* raw iteration counts */
+  TILE_FORMAT_F32 = 2,   /* smooth (fractional) iteration counts */
+  TILE_FORMAT_PACKED = 3 /* F32 data squeezed by pack.h, variable size */
+};
+
+/* Everything that determines the contents of a tile. Must not contain
+ * padding, it is hashed and written to disk as is. */
+typedef struct {
+  double x, y;   /* point of pixel (0, 0) in the complex plane */
+  double dx, dy; /* step between two pixels */
+  double maxIterations;
+  uint32_t width, height;
+  uint32_t format; /* enum TileFormat */
+  uint32_t kernel; /* which iteration kernel produced the data */
+  uint32_t julia;   /* 1 for the Julia set of (cx, cy), 0 for Mandelbrot */
+  uint32_t formula; /* enum Formula */
+  double cx, cy;
+} TileKey;
+
+typedef struct {
+  TileKey key;
+  const void *data; /* width * height values of key.format, or a packed
+                       tile of size bytes */
+  size_t size;
+
+  void *map;
+  size_t mapSize;
+} Tile;
+
+typedef struct TileStore TileStore;
+
+/* capacity in bytes, 0 for no limit. */
+TileStore *tileStoreOpen(const char *path, uint64_t capacity);
+void tileStoreClose(TileStore *store);
+
+/* Maps the tile matching key. Returns 0 when it is not in the store. */
+char tileStoreGet(TileStore *store, const TileKey *key, Tile *tile);
+void tileStoreRelease(Tile *tile);
+
+/* Writes a tile and publishes it in the index. size must match the format
+ * unless it is TILE_FORMAT_PACKED. Returns 0 on failure. */
+char tileStorePut(TileStore *store, const TileKey *key, const void *data,
+                  size_t size);
+
+size_t tileStoreCount(TileStore *store);
+/* Bytes per pixel, 0 for variable size formats. */
+size_t tileFormatSize(uint32_t format);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef WILK_VIEW_H
+#define WILK_VIEW_H
+
+#include <stdint.h>
+#include <wilk/tilestore.h>
+
+typedef struct {
+  double x, y;
+  double scale;
+  double maxIterations;
+  uint32_t kernel;  /* enum Kernel */
+  uint32_t formula; /* enum Formula */
+  uint32_t julia;   /* iterate the pixels with a fixed c of (cx, cy) */
+  double cx, cy;
+} View;
+
+/* One navigation step, as produced by a key press or a scroll event. */
+typedef struct {
+  int panX, panY; /* multiples of the pan speed */
+  double zoom;    /* log2 of the scale factor */
+  double pivotX, pivotY; /* point kept in place, -1 to 1 across the view */
+  double iterations;
+} Motion;
+
+void viewApply(View *view, const Motion *motion);
+char viewEquals(const View *a, const View *b);
+/* Whether both show the same formula and Julia c, whatever part of it. */
+char viewSameSet(const View *a, const View *b);
+
+/* Describes the tile covering the whole view at the given pixel size, using
+ * the same pixel to complex mapping as wilk.frag. */
+void viewTileKey(const View *view, uint32_t width, uint32_t height,
+                 uint32_t format, TileKey *key);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef WILK_ZOOM_H
+#define WILK_ZOOM_H
+
+#include <wilk/view.h>
+
+/*
+ * Animated navigation.
+ *
+ * Input moves the target view, the view on screen follows it exponentially
+ * along the similarity transform between the two, so a zoom keeps the
+ * point under the cursor in place. Frames in between are drawn by
+ * rescaling the last rendered iteration texture.
+ */
+
+/* Moves shown toward target, dt is the time since the last step. Returns 1
+ * once shown has arrived, right away if target shows another formula or
+ * Julia set. */
+char zoomStep(View *shown, const View *target, double dt);
+
+/* How far rendered is from being good enough to display shown, values of 1
+ * or more ask for a full render. */
+double zoomError(const View *rendered, const View *shown);
+
+/* Maps the screen of shown onto the texture of rendered: a texture
+ * coordinate is (u * transform[0] + transform[1..2] + 1) / 2, where u runs
+ * from -1 to 1 across the screen. */
+void zoomTransform(const View *rendered, const View *shown, float transform[3]);
+
+/* Returns 1 if rendered is of the same set and has every point of shown,
+ * at any resolution, so it can stand in for it. */
+char zoomCovers(const View *rendered, const View *shown);
+
+#endif
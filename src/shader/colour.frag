@@ -0,0 +1,85 @@
+#version 400 core
+/* Colours the iteration counts left behind by wilk.frag or the CPU kernel. */
+
+#define BINS 4096
+
+/* Values of enum Kernel in kernel.h. */
+#define KERNEL_DISTANCE 2
+/* Values of enum Upscale in renderer.h. */
+#define UPSCALE_EDGE 0
+/* DISTANCE_FAR in kernel.h. */
+#define FAR 8.0
+
+uniform sampler2D iterations;
+uniform float maxIterations;
+uniform vec2 resolution;
+/* Scale and offset from this screen to the view in iterations, see zoom.h. */
+uniform vec3 rescale;
+/* Part of iterations the view was rendered into, see renderer.h. */
+uniform vec2 extent;
+uniform int kernel;
+uniform int upscale;
+/* Colours the iterations spent per pixel instead, see stats.h. */
+uniform bool heatmap;
+
+/* Histogram equalisation, filled in by histogram.comp and cdf.comp. */
+uniform bool equalize;
+uniform sampler1D cdf;
+
+layout (location = 0) out vec4 fragColor;
+
+/* Bilinear, but texels unlike the nearest one count for less, so a
+ * stretched render does not smear escape counts into the set. */
+float edgeAware(vec2 uv) {
+  vec2 f = fract(uv * vec2(textureSize(iterations, 0)) - 0.5);
+  /* Gathered as (0, 1), (1, 1), (1, 0), (0, 0). */
+  vec4 v = textureGather(iterations, uv);
+  vec4 w = vec4((1.0 - f.x) * f.y, f.x * f.y, f.x * (1.0 - f.y),
+                (1.0 - f.x) * (1.0 - f.y));
+  float nearest = v.x, best = w.x;
+
+  for (int i = 1; i < 4; i++) {
+    if (w[i] > best) {
+      nearest = v[i];
+      best = w[i];
+    }
+  }
+
+  vec4 d = abs(v - nearest) / max(nearest, 1.0);
+  w /= 1.0 + 16.0 * d * d;
+  return dot(v, w) / dot(w, vec4(1.0));
+}
+
+/* Black through red and yellow to white as a pixel gets more expensive,
+ * on a log scale since most pixels escape early. */
+vec3 heat(float it) {
+  float t = log(1.0 + min(it, maxIterations)) / log(1.0 + maxIterations);
+
+  return clamp(vec3(3.0 * t, 3.0 * t - 1.0, 3.0 * t - 2.0), 0.0, 1.0);
+}
+
+void main() {
+  vec2 u = gl_FragCoord.xy / resolution * 2.0 - 1.0;
+  vec2 uv = (u * rescale.x + rescale.yz + 1.0) / 2.0;
+  /* Keep the filter off texels outside the rendered part. */
+  vec2 edge = 0.5 / (extent * vec2(textureSize(iterations, 0)));
+  uv = clamp(uv, edge, 1.0 - edge) * extent;
+  float it = upscale == UPSCALE_EDGE ? edgeAware(uv)
+                                     : texture(iterations, uv).r;
+  float t = it / maxIterations;
+
+  if (heatmap && kernel != KERNEL_DISTANCE) {
+    fragColor = vec4(heat(it), 1.0);
+    return;
+  }
+
+  if (kernel == KERNEL_DISTANCE) {
+    /* it is the distance to the set in pixels, dark at the boundary. */
+    t = it > 0.0 ? pow(clamp(it / FAR, 0.0, 1.0), 0.35) : 0.0;
+  } else if (equalize) {
+    int bin = int(min(it, maxIterations) / maxIterations * float(BINS - 1));
+    t = bin == BINS - 1 ? 0.0 : texelFetch(cdf, bin, 0).r;
+  }
+
+  fragColor = vec4(t, 0.0, t, 1.0);
+}
@@ -0,0 +1,84 @@
+/* Iteration bodies for wilk.frag and chunk.comp. shader.c puts this file
+ * right after their #version line, behind a #define FORMULA with a value of
+ * enum Formula in formula.h, so each program only holds one of them. */
+
+#define FORMULA_MANDELBROT 0
+#define FORMULA_BURNING_SHIP 1
+#define FORMULA_TRICORN 2
+#define FORMULA_CUBIC 3
+#define FORMULA_QUARTIC 4
+#define FORMULA_CUSTOM 5
+
+dvec2 complexSquared(dvec2 z) {
+  return dvec2(z.x * z.x - z.y * z.y, 2.0 * z.x * z.y);
+}
+
+dvec2 complexMul(dvec2 a, dvec2 b) {
+  return dvec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+/* z <- f(z) + c and the dz <- f'(z) dz + dc next to it, see step() and
+ * stepDerivative() in kernel.c. */
+#if FORMULA == FORMULA_BURNING_SHIP
+
+dvec2 formula(dvec2 z, dvec2 c) {
+  return complexSquared(abs(z)) + c;
+}
+
+dvec2 formulaDerivative(dvec2 z, dvec2 dz, dvec2 dc) {
+  dvec2 d = 2.0 * complexMul(z, dz);
+  return dvec2(d.x, z.x * z.y < 0.0 ? -d.y : d.y) + dc;
+}
+
+#elif FORMULA == FORMULA_TRICORN
+
+dvec2 formula(dvec2 z, dvec2 c) {
+  return complexSquared(dvec2(z.x, -z.y)) + c;
+}
+
+dvec2 formulaDerivative(dvec2 z, dvec2 dz, dvec2 dc) {
+  dvec2 d = 2.0 * complexMul(z, dz);
+  return dvec2(d.x, -d.y) + dc;
+}
+
+#elif FORMULA == FORMULA_CUBIC
+
+dvec2 formula(dvec2 z, dvec2 c) {
+  return complexMul(complexSquared(z), z) + c;
+}
+
+dvec2 formulaDerivative(dvec2 z, dvec2 dz, dvec2 dc) {
+  return 3.0 * complexMul(complexSquared(z), dz) + dc;
+}
+
+#elif FORMULA == FORMULA_QUARTIC
+
+dvec2 formula(dvec2 z, dvec2 c) {
+  return complexSquared(complexSquared(z)) + c;
+}
+
+dvec2 formulaDerivative(dvec2 z, dvec2 dz, dvec2 dc) {
+  return 4.0 * complexMul(complexMul(complexSquared(z), z), dz) + dc;
+}
+
+#elif FORMULA == FORMULA_CUSTOM
+
+/* Generated by formula.c and put after this file. Custom formulas only
+ * render escape time. */
+dvec2 formula(dvec2 z, dvec2 c);
+
+dvec2 formulaDerivative(dvec2 z, dvec2 dz, dvec2 dc) {
+  return dz;
+}
+
+#else
+
+dvec2 formula(dvec2 z, dvec2 c) {
+  return complexSquared(z) + c;
+}
+
+dvec2 formulaDerivative(dvec2 z, dvec2 dz, dvec2 dc) {
+  return 2.0 * complexMul(z, dz) + dc;
+}
+
+#endif
@@ -1,34 +1,67 @@
 #version 400 core
-/* Stupid simple shader for mandelbrot. */
+/* Stupid simple shader for mandelbrot, formula() and formulaDerivative()
+ * come from formula.glsl. */
+
+/* Values of enum Kernel in kernel.h. */
+#define KERNEL_ESCAPE_TIME 1
+#define KERNEL_DISTANCE 2
+
+#define DISTANCE_BAILOUT (256.0 * 256.0)
 
 uniform double scale;
 uniform double maxIterations;
 uniform dvec2 loc;
 uniform dvec2 limits;
+uniform int kernel;
+/* Julia sets start z at the pixel and keep c fixed. */
+uniform bool julia;
+uniform dvec2 juliaC;
+
+/* Iteration count or distance in pixels, coloured by colour.frag. */
+layout (location = 0) out float iterations;
+
+/* Tracks dz/dc (dz/dz0 for Julia sets) next to z, see distanceEstimate()
+ * in kernel.c. */
+float distance(dvec2 z0, dvec2 c, double pixel) {
+  dvec2 z = z0;
+  dvec2 dz = dvec2(1.0, 0.0);
+  dvec2 dc = julia ? dvec2(0.0) : dvec2(1.0, 0.0);
+  int it = 0;
+
+  while (dot(z, z) <= DISTANCE_BAILOUT && it < maxIterations)
+  {
+    dz = formulaDerivative(z, dz, dc);
+    z = formula(z, c);
+
+    it++;
+  }
 
-layout (location = 0) out vec4 fragColor;
+  if (dot(z, z) <= DISTANCE_BAILOUT)
+    return 0.0;
 
-dvec2 complexSquared(dvec2 z) {
-  return dvec2(
-    z.x * z.x - z.y * z.y,
-    2.0 * z.x * z.y
-  );
+  float r = float(length(z));
+  return float(0.5 * r * log(r) / length(dz) / pixel);
 }
 
 void main() {  
-  dvec2 limits = limits*scale;
-  dvec2 c = dvec2((gl_FragCoord.x - limits.x / 2) * 4.0 / limits.x + loc.x,
-                  (gl_FragCoord.y - limits.y / 2) * 4.0 / limits.y + loc.y);
+  /* loc is the centre of the screen, which spans 4 / scale. */
+  dvec2 z0 = (dvec2(gl_FragCoord.xy) - limits / 2) * 4.0 / (limits * scale) + loc;
+  dvec2 c = julia ? juliaC : z0;
+
+  if (kernel == KERNEL_DISTANCE) {
+    iterations = distance(z0, c, 4.0 / (limits.x * scale));
+    return;
+  }
 
-  dvec2 z = c;
+  dvec2 z = z0;
   int it = 0;
   
-  while (z.x * z.x + z.y <= 4 && it < maxIterations) 
+  while (z.x * z.x + z.y * z.y <= 4 && it < maxIterations) 
   {
-    z = complexSquared(z) + c;
+    z = formula(z, c);
 
     it++;
   }
 
-  fragColor = vec4(it / maxIterations, 0.0, it / maxIterations, 1.0);
+  iterations = float(it);
 }
@@ -0,0 +1,134 @@
+#include <wilk/arena.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#define ALIGNMENT 16
+/* Smallest block, the first shader source already needs a few pages. */
+#define MIN_BLOCK (64 * 1024)
+
+struct ArenaBlock {
+  ArenaBlock *next;
+  size_t size;
+};
+
+static pthread_key_t threadKey;
+static pthread_once_t threadKeyOnce = PTHREAD_ONCE_INIT;
+
+static void destroyThreadArena(void *arena) {
+  arenaDestroy(arena);
+  free(arena);
+}
+
+static void createThreadKey(void) {
+  pthread_key_create(&threadKey, destroyThreadArena);
+}
+
+Arena *arenaThread(void) {
+  Arena *arena;
+
+  pthread_once(&threadKeyOnce, createThreadKey);
+  arena = pthread_getspecific(threadKey);
+
+  if (!arena) {
+    arena = calloc(1, sizeof(*arena));
+    if (!arena)
+      abort();
+    pthread_setspecific(threadKey, arena);
+  }
+
+  return arena;
+}
+
+static size_t align(size_t size) {
+  return (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+}
+
+void *arenaAlloc(Arena *arena, size_t size) {
+  ArenaBlock *block;
+
+  size = align(size ? size : 1);
+
+  if (!arena->base && !arena->blocks) {
+    arena->size = size > MIN_BLOCK ? align(size) : MIN_BLOCK;
+    arena->base = malloc(arena->size);
+    arena->systemAllocations++;
+
+    if (!arena->base) {
+      arena->size = 0;
+      return NULL;
+    }
+  }
+
+  if (arena->size - arena->used >= size) {
+    void *p = arena->base + arena->used;
+
+    arena->used += size;
+    arena->inUse += size;
+    if (arena->inUse > arena->peak)
+      arena->peak = arena->inUse;
+    return p;
+  }
+
+  /* Spill, the next reset makes base big enough. */
+  block = malloc(align(sizeof(*block)) + size);
+  arena->systemAllocations++;
+  if (!block)
+    return NULL;
+
+  block->next = arena->blocks;
+  block->size = size;
+  arena->blocks = block;
+  arena->inUse += size;
+  if (arena->inUse > arena->peak)
+    arena->peak = arena->inUse;
+
+  return (unsigned char *)block + align(sizeof(*block));
+}
+
+ArenaMark arenaMark(const Arena *arena) {
+  ArenaMark mark = {arena->used, arena->blocks};
+  return mark;
+}
+
+void arenaRewind(Arena *arena, ArenaMark mark) {
+  while (arena->blocks != mark.blocks) {
+    ArenaBlock *block = arena->blocks;
+
+    arena->blocks = block->next;
+    arena->inUse -= block->size;
+    free(block);
+  }
+
+  arena->inUse -= arena->used - mark.used;
+  arena->used = mark.used;
+}
+
+void arenaReset(Arena *arena) {
+  ArenaMark start = {0, NULL};
+
+  arenaRewind(arena, start);
+
+  if (arena->peak > arena->size) {
+    free(arena->base);
+    arena->size = align(arena->peak);
+    arena->base = malloc(arena->size);
+    arena->systemAllocations++;
+
+    if (!arena->base)
+      arena->size = 0;
+  }
+
+  arena->peak = 0;
+  arena->systemAllocations = 0;
+}
+
+void arenaDestroy(Arena *arena) {
+  ArenaMark start = {0, NULL};
+
+  arenaRewind(arena, start);
+  free(arena->base);
+  arena->base = NULL;
+  arena->size = 0;
+  arena->peak = 0;
+}
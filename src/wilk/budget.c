@@ -0,0 +1,69 @@
+#include <wilk/budget.h>
+
+#include <math.h>
+
+/* Weight of the newest frame in the average. */
+#define SMOOTHING 0.25
+/* Slack around the target before anything changes. */
+#define OVER 1.1
+#define UNDER 0.7
+#define RESOLUTION_STEP 0.8
+#define ITERATIONS_STEP 0.5
+#define HOLD_FRAMES 4
+
+void budgetInit(Budget *budget, double target) {
+  budget->target = target;
+  budget->average = target;
+  budget->resolution = 1.0;
+  budget->iterations = 1.0;
+  budget->chunks = target > 0.0 ? 1 : BUDGET_MAX_CHUNKS;
+  budget->hold = 0;
+}
+
+/* Gives up the cheapest kind of detail first. */
+static void degrade(Budget *budget, char moving) {
+  if (budget->chunks > 1)
+    budget->chunks--;
+  else if (moving && budget->resolution > BUDGET_MIN_RESOLUTION)
+    budget->resolution =
+        fmax(budget->resolution * RESOLUTION_STEP, BUDGET_MIN_RESOLUTION);
+  else if (moving && budget->iterations > BUDGET_MIN_ITERATIONS)
+    budget->iterations =
+        fmax(budget->iterations * ITERATIONS_STEP, BUDGET_MIN_ITERATIONS);
+}
+
+static void improve(Budget *budget) {
+  if (budget->iterations < 1.0)
+    budget->iterations = fmin(budget->iterations / ITERATIONS_STEP, 1.0);
+  else if (budget->resolution < 1.0)
+    budget->resolution = fmin(budget->resolution / RESOLUTION_STEP, 1.0);
+  else if (budget->chunks < BUDGET_MAX_CHUNKS)
+    budget->chunks++;
+}
+
+void budgetUpdate(Budget *budget, double frameTime, char moving) {
+  if (budget->target <= 0.0)
+    return;
+
+  budget->average += (frameTime - budget->average) * SMOOTHING;
+
+  /* A still view always ends up at full detail. */
+  if (!moving) {
+    budget->resolution = 1.0;
+    budget->iterations = 1.0;
+  }
+
+  if (budget->hold) {
+    budget->hold--;
+    return;
+  }
+
+  if (budget->average > budget->target * OVER)
+    degrade(budget, moving);
+  else if (budget->average < budget->target * UNDER)
+    improve(budget);
+  else
+    return;
+
+  budget->hold = HOLD_FRAMES;
+}
@@ -0,0 +1,110 @@
+#include <wilk/codec.h>
+
+#include <string.h>
+
+/* Control words: the top bit marks a run of the one delta that follows, or
+ * else that many literal deltas follow. */
+#define RUN16 0x8000u
+#define MAX_COUNT16 0x7fffu
+/* Shorter runs are cheaper as part of a literal. */
+#define MIN_RUN 3
+
+size_t codecBound16(size_t count) {
+  return (count + count / MAX_COUNT16 + 2) * sizeof(uint16_t);
+}
+
+static uint16_t deltaAt(const uint16_t *in, size_t i) {
+  return (uint16_t)(in[i] - (i ? in[i - 1] : 0));
+}
+
+static size_t runLength16(const uint16_t *in, size_t i, size_t count) {
+  uint16_t delta = deltaAt(in, i);
+  size_t n = 1;
+
+  while (i + n < count && n < MAX_COUNT16 && deltaAt(in, i + n) == delta)
+    n++;
+
+  return n;
+}
+
+size_t codecEncode16(const uint16_t *in, size_t count, unsigned char *out) {
+  unsigned char *p = out;
+  size_t i = 0;
+
+  while (i < count) {
+    size_t run = runLength16(in, i, count), literal = 0;
+    uint16_t control, delta;
+
+    if (run >= MIN_RUN) {
+      control = RUN16 | (uint16_t)run;
+      delta = deltaAt(in, i);
+      memcpy(p, &control, sizeof(control));
+      memcpy(p + sizeof(control), &delta, sizeof(delta));
+      p += 2 * sizeof(control);
+      i += run;
+      continue;
+    }
+
+    while (i + literal < count && literal < MAX_COUNT16 &&
+           runLength16(in, i + literal, count) < MIN_RUN)
+      literal++;
+
+    control = (uint16_t)literal;
+    memcpy(p, &control, sizeof(control));
+    p += sizeof(control);
+
+    for (size_t k = 0; k < literal; k++, p += sizeof(delta)) {
+      delta = deltaAt(in, i + k);
+      memcpy(p, &delta, sizeof(delta));
+    }
+
+    i += literal;
+  }
+
+  return p - out;
+}
+
+char codecDecode16(const unsigned char *in, size_t size, uint16_t *out,
+                   size_t count) {
+  const unsigned char *end = in + size;
+  uint16_t value = 0;
+  size_t i = 0;
+
+  while (in < end) {
+    uint16_t control, delta;
+    size_t n;
+
+    if ((size_t)(end - in) < sizeof(control))
+      return 0;
+
+    memcpy(&control, in, sizeof(control));
+    in += sizeof(control);
+    n = control & MAX_COUNT16;
+
+    if (n > count - i)
+      return 0;
+
+    if (control & RUN16) {
+      if ((size_t)(end - in) < sizeof(delta))
+        return 0;
+
+      memcpy(&delta, in, sizeof(delta));
+      in += sizeof(delta);
+
+      for (size_t k = 0; k < n; k++)
+        out[i + k] = value = (uint16_t)(value + delta);
+    } else {
+      if ((size_t)(end - in) < n * sizeof(delta))
+        return 0;
+
+      for (size_t k = 0; k < n; k++, in += sizeof(delta)) {
+        memcpy(&delta, in, sizeof(delta));
+        out[i + k] = value = (uint16_t)(value + delta);
+      }
+    }
+
+    i += n;
+  }
+
+  return i == count;
+}
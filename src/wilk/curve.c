@@ -0,0 +1,71 @@
+#include <wilk/curve.h>
+
+#include <stddef.h>
+
+static const char *names[] = {"rows", "morton", "hilbert"};
+
+const char *curveName(uint32_t curve) {
+  return curve < sizeof(names) / sizeof(*names) ? names[curve] : NULL;
+}
+
+/* Cell d of the Z order curve, the bits of x and y interleaved. */
+static void mortonCell(uint32_t d, uint32_t *x, uint32_t *y) {
+  *x = 0;
+  *y = 0;
+  for (int bit = 0; bit < 16; bit++) {
+    *x |= (d >> (2 * bit) & 1) << bit;
+    *y |= (d >> (2 * bit + 1) & 1) << bit;
+  }
+}
+
+/* Cell d of the Hilbert curve over an n x n grid, n a power of two. */
+static void hilbertCell(uint32_t n, uint32_t d, uint32_t *x, uint32_t *y) {
+  uint32_t rx, ry, swap;
+
+  *x = 0;
+  *y = 0;
+  for (uint32_t s = 1; s < n; s *= 2) {
+    rx = 1 & (d / 2);
+    ry = 1 & (d ^ rx);
+
+    /* Rotate the quadrant so the curve enters and leaves it right. */
+    if (!ry) {
+      if (rx) {
+        *x = s - 1 - *x;
+        *y = s - 1 - *y;
+      }
+      swap = *x;
+      *x = *y;
+      *y = swap;
+    }
+
+    *x += s * rx;
+    *y += s * ry;
+    d /= 4;
+  }
+}
+
+void curveOrder(uint32_t curve, uint32_t columns, uint32_t rows,
+                uint32_t *order) {
+  uint32_t n = 1, x, y;
+  size_t count = 0;
+
+  if (curve != CURVE_MORTON && curve != CURVE_HILBERT) {
+    for (uint32_t i = 0; i < columns * rows; i++)
+      order[i] = i;
+    return;
+  }
+
+  while (n < columns || n < rows)
+    n *= 2;
+
+  for (uint64_t d = 0; d < (uint64_t)n * n; d++) {
+    if (curve == CURVE_MORTON)
+      mortonCell((uint32_t)d, &x, &y);
+    else
+      hilbertCell(n, (uint32_t)d, &x, &y);
+
+    if (x < columns && y < rows)
+      order[count++] = y * columns + x;
+  }
+}
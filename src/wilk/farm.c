@@ -0,0 +1,665 @@
+#define _GNU_SOURCE
+#include <wilk/arena.h>
+#include <wilk/curve.h>
+#include <wilk/farm.h>
+#include <wilk/formula.h>
+#include <wilk/kernel.h>
+#include <wilk/pack.h>
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FARM_MAGIC 0x464b4c57 /* "WLKF" */
+#define FARM_VERSION 6
+/* Side of the tiles handed out. */
+#define FARM_TILE 256
+/* Tiles queued per worker, so it never waits for the next one. */
+#define FARM_INFLIGHT 2
+#define FARM_MAX_WORKERS 64
+/* A worker with work that stays silent this long is given up on. Workers
+ * say they are alive this often while rendering, however long a tile
+ * takes. */
+#define FARM_TIMEOUT 30.0
+#define FARM_HEARTBEAT 5
+#define FARM_CONNECT_TRIES 50
+
+enum {
+  MESSAGE_HELLO = 1, /* worker: uint32_t threads */
+  MESSAGE_TILE,      /* coordinator: TileKey, then the source of a custom
+                        formula with its terminating zero */
+  MESSAGE_RESULT,    /* worker: tile data, see pack.h */
+  MESSAGE_BYE,       /* coordinator: no more work */
+  MESSAGE_ALIVE      /* worker: still rendering */
+};
+
+/* Both ends are expected to share byte order and double format. */
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t type;
+  uint32_t id; /* tile number for MESSAGE_TILE and MESSAGE_RESULT */
+  uint32_t length;
+} MessageHeader;
+
+typedef struct {
+  TileKey key;
+  uint32_t x, y; /* offset in the whole render */
+  int worker;    /* -1 while queued */
+  char done;
+} FarmTile;
+
+typedef struct {
+  int fd;
+  unsigned char *buffer;
+  size_t size, capacity;
+  unsigned int inflight;
+  double lastSeen;
+} Connection;
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Fills in a unix or tcp address, returns the socket or -1. */
+static int openSocket(const char *address, char listening) {
+  struct addrinfo hints = {0}, *results, *ai;
+  char host[256];
+  const char *port;
+  int fd = -1;
+
+  if (strncmp(address, "unix:", 5) == 0) {
+    struct sockaddr_un un = {0};
+
+    un.sun_family = AF_UNIX;
+    if (strlen(address + 5) >= sizeof(un.sun_path))
+      return -1;
+    strcpy(un.sun_path, address + 5);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+      return -1;
+
+    if (listening) {
+      unlink(un.sun_path);
+      if (bind(fd, (struct sockaddr *)&un, sizeof(un)) == 0 &&
+          listen(fd, FARM_MAX_WORKERS) == 0)
+        return fd;
+    } else if (connect(fd, (struct sockaddr *)&un, sizeof(un)) == 0) {
+      return fd;
+    }
+
+    close(fd);
+    return -1;
+  }
+
+  port = strrchr(address, ':');
+  if (!port || (size_t)(port - address) >= sizeof(host))
+    return -1;
+
+  memcpy(host, address, port - address);
+  host[port - address] = '\0';
+  port++;
+
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listening ? AI_PASSIVE : 0;
+
+  if (getaddrinfo(*host ? host : NULL, port, &hints, &results) != 0)
+    return -1;
+
+  for (ai = results; ai; ai = ai->ai_next) {
+    int one = 1;
+
+    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+                ai->ai_protocol);
+    if (fd < 0)
+      continue;
+
+    if (listening) {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+          listen(fd, FARM_MAX_WORKERS) == 0)
+        break;
+    } else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+      break;
+    }
+
+    close(fd);
+    fd = -1;
+  }
+
+  freeaddrinfo(results);
+  return fd;
+}
+
+static char sendAll(int fd, const void *buffer, size_t size) {
+  const char *p = buffer;
+
+  while (size) {
+    ssize_t sent = send(fd, p, size, MSG_NOSIGNAL);
+
+    if (sent < 0) {
+      if (errno == EINTR)
+        continue;
+      return 0;
+    }
+
+    p += sent;
+    size -= sent;
+  }
+
+  return 1;
+}
+
+static char recvAll(int fd, void *buffer, size_t size) {
+  char *p = buffer;
+
+  while (size) {
+    ssize_t got = recv(fd, p, size, 0);
+
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      return 0;
+
+    p += got;
+    size -= got;
+  }
+
+  return 1;
+}
+
+static char sendMessage(int fd, uint16_t type, uint32_t id, const void *body,
+                        uint32_t length) {
+  MessageHeader header = {FARM_MAGIC, FARM_VERSION, type, id, length};
+
+  return sendAll(fd, &header, sizeof(header)) &&
+         (!length || sendAll(fd, body, length));
+}
+
+/* Workers compile custom formulas themselves, see formula.h. */
+static char sendTile(int fd, uint32_t id, const TileKey *key,
+                     const char *source) {
+  uint32_t length = source ? strlen(source) + 1 : 0;
+  MessageHeader header = {FARM_MAGIC, FARM_VERSION, MESSAGE_TILE, id,
+                          sizeof(*key) + length};
+
+  return sendAll(fd, &header, sizeof(header)) &&
+         sendAll(fd, key, sizeof(*key)) &&
+         (!length || sendAll(fd, source, length));
+}
+
+static char validHeader(const MessageHeader *header) {
+  return header->magic == FARM_MAGIC && header->version == FARM_VERSION;
+}
+
+/* No message is longer than the result of a whole tile. */
+static size_t messageLimit(void) {
+  TileKey key = {0};
+
+  key.width = FARM_TILE;
+  key.height = FARM_TILE;
+  key.format = TILE_FORMAT_F32;
+  return packBound(&key) > sizeof(key) ? packBound(&key) : sizeof(key);
+}
+
+/* Coordinator */
+
+static void dropWorker(Connection *workers, int index, FarmTile *tiles,
+                       size_t count) {
+  Connection *worker = &workers[index];
+
+  for (size_t i = 0; i < count; i++)
+    if (tiles[i].worker == index && !tiles[i].done)
+      tiles[i].worker = -1;
+
+  if (worker->inflight)
+    fprintf(stderr, "[Info] Worker %d lost, requeueing %u tiles\n", index,
+            worker->inflight);
+
+  close(worker->fd);
+  free(worker->buffer);
+  memset(worker, 0, sizeof(*worker));
+  worker->fd = -1;
+}
+
+/* Copies a finished tile into the whole render. */
+static char storeResult(const FarmTile *tile, const unsigned char *body,
+                        uint32_t length, const TileKey *key, float *out) {
+  size_t count = (size_t)tile->key.width * tile->key.height;
+  Arena *arena = arenaThread();
+  ArenaMark mark = arenaMark(arena);
+  float *data = arenaAlloc(arena, count * sizeof(*data));
+  char ok;
+
+  if (!data)
+    return 0;
+
+  ok = packDecode(&tile->key, body, length, data);
+
+  for (uint32_t j = 0; ok && j < tile->key.height; j++)
+    memcpy(out + (size_t)(tile->y + j) * key->width + tile->x,
+           data + (size_t)j * tile->key.width,
+           tile->key.width * sizeof(*out));
+
+  arenaRewind(arena, mark);
+  return ok;
+}
+
+/* Handles every complete message in the buffer of a worker. Returns 0 if
+ * the worker misbehaved. */
+static char handleMessages(Connection *worker, int index, FarmTile *tiles,
+                           size_t count, size_t *done, const TileKey *key,
+                           float *out) {
+  size_t offset = 0;
+
+  while (worker->size - offset >= sizeof(MessageHeader)) {
+    MessageHeader header;
+    const unsigned char *body;
+
+    memcpy(&header, worker->buffer + offset, sizeof(header));
+    if (!validHeader(&header) || header.length > messageLimit())
+      return 0;
+
+    if (worker->size - offset - sizeof(header) < header.length)
+      break;
+
+    body = worker->buffer + offset + sizeof(header);
+    offset += sizeof(header) + header.length;
+
+    if (header.type != MESSAGE_RESULT)
+      continue;
+
+    /* Late answers for tiles that were handed to someone else are fine. */
+    if (header.id >= count || tiles[header.id].done ||
+        tiles[header.id].worker != index)
+      continue;
+
+    if (!storeResult(&tiles[header.id], body, header.length, key, out))
+      return 0;
+
+    tiles[header.id].done = 1;
+    worker->inflight--;
+    (*done)++;
+  }
+
+  memmove(worker->buffer, worker->buffer + offset, worker->size - offset);
+  worker->size -= offset;
+  return 1;
+}
+
+static char readWorker(Connection *worker) {
+  ssize_t got;
+
+  if (worker->capacity - worker->size < 65536) {
+    size_t capacity = worker->capacity ? worker->capacity * 2 : 1 << 20;
+    unsigned char *buffer;
+
+    /* Complete messages are handled after every read, so more than two
+     * partial ones never pile up. */
+    if (worker->capacity &&
+        capacity > 2 * (sizeof(MessageHeader) + messageLimit()) + 65536)
+      return 0;
+
+    buffer = realloc(worker->buffer, capacity);
+    if (!buffer)
+      return 0;
+
+    worker->buffer = buffer;
+    worker->capacity = capacity;
+  }
+
+  got = recv(worker->fd, worker->buffer + worker->size,
+             worker->capacity - worker->size, 0);
+  if (got < 0 && errno == EINTR)
+    return 1;
+  if (got <= 0)
+    return 0;
+
+  worker->size += got;
+  worker->lastSeen = now();
+  return 1;
+}
+
+static void assignTiles(Connection *workers, FarmTile *tiles, size_t count,
+                        const char *source) {
+  size_t next = 0;
+
+  for (int w = 0; w < FARM_MAX_WORKERS; w++) {
+    Connection *worker = &workers[w];
+
+    while (worker->fd >= 0 && worker->inflight < FARM_INFLIGHT) {
+      while (next < count && (tiles[next].done || tiles[next].worker >= 0))
+        next++;
+
+      if (next == count)
+        return;
+
+      if (!sendTile(worker->fd, next, &tiles[next].key, source)) {
+        dropWorker(workers, w, tiles, count);
+        break;
+      }
+
+      if (!worker->inflight)
+        worker->lastSeen = now();
+
+      tiles[next].worker = w;
+      worker->inflight++;
+    }
+  }
+}
+
+char farmCoordinate(const char *address, const TileKey *key, float *out) {
+  Connection workers[FARM_MAX_WORKERS];
+  struct pollfd fds[FARM_MAX_WORKERS + 1];
+  uint32_t columns = (key->width + FARM_TILE - 1) / FARM_TILE;
+  uint32_t rows = (key->height + FARM_TILE - 1) / FARM_TILE;
+  size_t count = (size_t)columns * rows, done = 0;
+  const char *source = formulaSource(key->formula);
+  FarmTile *tiles;
+  uint32_t *order;
+  int listener;
+
+  if (FORMULA_INDEX(key->formula) == FORMULA_CUSTOM && !source) {
+    fputs("[Error] The custom formula of the render is not loaded\n", stderr);
+    return 0;
+  }
+
+  listener = openSocket(address, 1);
+  if (listener < 0) {
+    fprintf(stderr, "[Error] Unable to listen on %s: %s\n", address,
+            strerror(errno));
+    return 0;
+  }
+
+  tiles = calloc(count, sizeof(*tiles));
+  order = malloc(count * sizeof(*order));
+  if (!tiles || !order) {
+    free(tiles);
+    free(order);
+    close(listener);
+    return 0;
+  }
+
+  /* Tiles are handed out along a Hilbert curve, so a worker's next tile is
+   * likely next to its last one and of similar cost. */
+  curveOrder(CURVE_HILBERT, columns, rows, order);
+  for (size_t i = 0; i < count; i++) {
+    FarmTile *tile = &tiles[i];
+
+    tile->x = order[i] % columns * FARM_TILE;
+    tile->y = order[i] / columns * FARM_TILE;
+    tile->worker = -1;
+    tile->key = *key;
+    tile->key.x = key->x + tile->x * key->dx;
+    tile->key.y = key->y + tile->y * key->dy;
+    tile->key.width =
+        key->width - tile->x < FARM_TILE ? key->width - tile->x : FARM_TILE;
+    tile->key.height =
+        key->height - tile->y < FARM_TILE ? key->height - tile->y : FARM_TILE;
+  }
+  free(order);
+
+  memset(workers, 0, sizeof(workers));
+  for (int i = 0; i < FARM_MAX_WORKERS; i++)
+    workers[i].fd = -1;
+
+  printf("[Info] Coordinating %zu tiles on %s\n", count, address);
+
+  while (done < count) {
+    nfds_t n = 1;
+    double t;
+
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+
+    for (int i = 0; i < FARM_MAX_WORKERS; i++) {
+      fds[i + 1].fd = workers[i].fd;
+      fds[i + 1].events = POLLIN;
+      fds[i + 1].revents = 0;
+      n++;
+    }
+
+    if (poll(fds, n, 1000) < 0 && errno != EINTR)
+      break;
+
+    if (fds[0].revents & POLLIN) {
+      int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+
+      for (int i = 0; fd >= 0 && i < FARM_MAX_WORKERS; i++)
+        if (workers[i].fd < 0) {
+          workers[i].fd = fd;
+          workers[i].lastSeen = now();
+          printf("[Info] Worker %d connected\n", i);
+          fd = -1;
+        }
+
+      if (fd >= 0)
+        close(fd);
+    }
+
+    t = now();
+    for (int i = 0; i < FARM_MAX_WORKERS; i++) {
+      Connection *worker = &workers[i];
+
+      if (worker->fd < 0)
+        continue;
+
+      if ((fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) &&
+          (!readWorker(worker) ||
+           !handleMessages(worker, i, tiles, count, &done, key, out))) {
+        dropWorker(workers, i, tiles, count);
+        continue;
+      }
+
+      if (worker->inflight && t - worker->lastSeen > FARM_TIMEOUT)
+        dropWorker(workers, i, tiles, count);
+    }
+
+    assignTiles(workers, tiles, count, source);
+  }
+
+  for (int i = 0; i < FARM_MAX_WORKERS; i++)
+    if (workers[i].fd >= 0) {
+      sendMessage(workers[i].fd, MESSAGE_BYE, 0, NULL, 0);
+      close(workers[i].fd);
+      free(workers[i].buffer);
+    }
+
+  if (strncmp(address, "unix:", 5) == 0)
+    unlink(address + 5);
+
+  close(listener);
+  free(tiles);
+  return done == count;
+}
+
+/* Worker */
+
+/* Sends MESSAGE_ALIVE every FARM_HEARTBEAT seconds while a tile renders. */
+typedef struct {
+  int fd;
+  pthread_mutex_t mutex; /* held for every send on fd */
+  pthread_cond_t wake;
+  char rendering, quit;
+} Heartbeat;
+
+static void *heartbeat(void *arg) {
+  Heartbeat *beat = arg;
+  struct timespec until;
+
+  pthread_mutex_lock(&beat->mutex);
+  while (!beat->quit) {
+    clock_gettime(CLOCK_MONOTONIC, &until);
+    until.tv_sec += FARM_HEARTBEAT;
+
+    if (pthread_cond_timedwait(&beat->wake, &beat->mutex, &until) ==
+            ETIMEDOUT &&
+        beat->rendering)
+      sendMessage(beat->fd, MESSAGE_ALIVE, 0, NULL, 0);
+  }
+  pthread_mutex_unlock(&beat->mutex);
+
+  return NULL;
+}
+
+static void setRendering(Heartbeat *beat, char rendering) {
+  pthread_mutex_lock(&beat->mutex);
+  beat->rendering = rendering;
+  pthread_mutex_unlock(&beat->mutex);
+}
+
+static char sendResult(Heartbeat *beat, uint32_t id, const void *body,
+                       uint32_t length) {
+  char ok;
+
+  pthread_mutex_lock(&beat->mutex);
+  beat->rendering = 0;
+  ok = sendMessage(beat->fd, MESSAGE_RESULT, id, body, length);
+  pthread_mutex_unlock(&beat->mutex);
+  return ok;
+}
+
+/* Whether key is a tile this worker can render, anything else comes from a
+ * confused or hostile coordinator. */
+static char validKey(const TileKey *key) {
+  if (key->width && key->width <= FARM_TILE && key->height &&
+      key->height <= FARM_TILE && key->format == TILE_FORMAT_F32 &&
+      (key->kernel == KERNEL_ESCAPE_TIME || key->kernel == KERNEL_DISTANCE) &&
+      FORMULA_INDEX(key->formula) < FORMULA_COUNT)
+    return 1;
+
+  fputs("[Error] Received an invalid tile\n", stderr);
+  return 0;
+}
+
+/* Makes the custom formula of key, if it has one, the one of this process
+ * by compiling the source the coordinator sent along. */
+static char loadFormula(const TileKey *key, const char *source) {
+  uint32_t formula;
+
+  if (kernelSupports(key))
+    return 1;
+
+  /* Another source of the same formula compiles to the same hash. */
+  if (!*source || !formulaCompile(source, &formula) || !kernelSupports(key)) {
+    fputs("[Error] Unable to load the custom formula of a tile\n", stderr);
+    return 0;
+  }
+
+  return 1;
+}
+
+char farmWork(const char *address) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t threads = cpus > 0 ? cpus : 1;
+  size_t capacity = 0;
+  float *data = NULL;
+  unsigned char *encoded = NULL;
+  Heartbeat beat;
+  pthread_condattr_t attr;
+  pthread_t beater;
+  char ok = 0, beating = 0;
+  int fd = -1;
+
+  memset(&beat, 0, sizeof(beat));
+  beat.fd = -1;
+
+  /* The coordinator may still be starting up. */
+  for (int i = 0; i < FARM_CONNECT_TRIES && fd < 0; i++) {
+    fd = openSocket(address, 0);
+    if (fd < 0)
+      usleep(100000);
+  }
+
+  if (fd < 0) {
+    fprintf(stderr, "[Error] Unable to connect to %s\n", address);
+    return 0;
+  }
+
+  if (!sendMessage(fd, MESSAGE_HELLO, 0, &threads, sizeof(threads)))
+    goto out;
+
+  beat.fd = fd;
+  pthread_mutex_init(&beat.mutex, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&beat.wake, &attr);
+  pthread_condattr_destroy(&attr);
+  beating = pthread_create(&beater, NULL, heartbeat, &beat) == 0;
+
+  for (;;) {
+    static char source[FORMULA_MAX_SOURCE + 1];
+    MessageHeader header;
+    TileKey key;
+    size_t count, size;
+
+    if (!recvAll(fd, &header, sizeof(header)) || !validHeader(&header))
+      goto out;
+
+    if (header.type == MESSAGE_BYE) {
+      ok = 1;
+      goto out;
+    }
+
+    if (header.type != MESSAGE_TILE || header.length < sizeof(key) ||
+        header.length > sizeof(key) + FORMULA_MAX_SOURCE ||
+        !recvAll(fd, &key, sizeof(key)) ||
+        !recvAll(fd, source, header.length - sizeof(key)))
+      goto out;
+
+    source[header.length - sizeof(key)] = '\0';
+    if (!validKey(&key) || !loadFormula(&key, source))
+      goto out;
+
+    count = (size_t)key.width * key.height;
+    if (count > capacity) {
+      free(data);
+      free(encoded);
+      data = malloc(count * sizeof(*data));
+      encoded = malloc(packBound(&key));
+      capacity = count;
+
+      if (!data || !encoded)
+        goto out;
+    }
+
+    setRendering(&beat, 1);
+    if (!kernelRenderParallel(&key, data, threads))
+      goto out;
+    size = packEncode(&key, data, encoded);
+
+    if (!size || !sendResult(&beat, header.id, encoded, size))
+      goto out;
+  }
+
+out:
+  if (beat.fd >= 0) {
+    pthread_mutex_lock(&beat.mutex);
+    beat.quit = 1;
+    pthread_cond_signal(&beat.wake);
+    pthread_mutex_unlock(&beat.mutex);
+
+    if (beating)
+      pthread_join(beater, NULL);
+    pthread_cond_destroy(&beat.wake);
+    pthread_mutex_destroy(&beat.mutex);
+  }
+
+  close(fd);
+  free(data);
+  free(encoded);
+  return ok;
+}
@@ -0,0 +1,516 @@
+#include <wilk/formula.h>
+#include <wilk/jit.h>
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_OPS 64
+#define MAX_POWER 64
+#define MAX_SOURCE FORMULA_MAX_SOURCE
+
+static const char *const names[FORMULA_COUNT] = {
+    [FORMULA_MANDELBROT] = "mandelbrot", [FORMULA_BURNING_SHIP] = "ship",
+    [FORMULA_TRICORN] = "tricorn",       [FORMULA_CUBIC] = "cubic",
+    [FORMULA_QUARTIC] = "quartic",       [FORMULA_CUSTOM] = "custom",
+};
+
+typedef struct {
+  const char *at;
+  FormulaOp ops[MAX_OPS];
+  unsigned int count;
+  const char *error;
+} Parser;
+
+/* The custom formula of this process, one at most. */
+static struct {
+  uint32_t formula; /* 0 until one is loaded */
+  FormulaOp ops[MAX_OPS];
+  unsigned int count;
+  FormulaLoop loop;
+  char glsl[MAX_SOURCE];
+  char source[MAX_SOURCE]; /* for farm workers, see farm.c */
+} custom;
+
+const char *formulaName(uint32_t formula) {
+  return FORMULA_INDEX(formula) < FORMULA_COUNT
+             ? names[FORMULA_INDEX(formula)]
+             : "unknown";
+}
+
+char formulaParse(const char *name, uint32_t *formula) {
+  for (uint32_t i = 0; i < FORMULA_COUNT; i++) {
+    if (strcmp(name, names[i]) != 0)
+      continue;
+    if (i == FORMULA_CUSTOM && !custom.formula)
+      return 0;
+
+    *formula = i == FORMULA_CUSTOM ? custom.formula : i;
+    return 1;
+  }
+
+  return 0;
+}
+
+uint32_t formulaNext(uint32_t formula) {
+  uint32_t next = (FORMULA_INDEX(formula) + 1) % FORMULA_COUNT;
+
+  if (next == FORMULA_CUSTOM)
+    return custom.formula ? custom.formula : FORMULA_MANDELBROT;
+  return next;
+}
+
+/* Complex arithmetic shared by constant folding and the interpreter, in
+ * the same order as the code from jit.c. */
+static void evaluate(const FormulaOp *op, const double *re, const double *im,
+                     double *outRe, double *outIm) {
+  double ar = re[op->a], ai = im[op->a], br = re[op->b], bi = im[op->b], d;
+
+  switch (op->kind) {
+  case OP_CONST:
+    *outRe = op->re;
+    *outIm = op->im;
+    break;
+  case OP_ADD:
+    *outRe = ar + br;
+    *outIm = ai + bi;
+    break;
+  case OP_SUB:
+    *outRe = ar - br;
+    *outIm = ai - bi;
+    break;
+  case OP_MUL:
+    *outRe = ar * br - ai * bi;
+    *outIm = ar * bi + ai * br;
+    break;
+  case OP_DIV:
+    d = br * br + bi * bi;
+    *outRe = (ar * br + ai * bi) / d;
+    *outIm = (ai * br - ar * bi) / d;
+    break;
+  case OP_SQR:
+    *outRe = ar * ar - ai * ai;
+    *outIm = ar * ai + ar * ai;
+    break;
+  case OP_SCALE:
+    *outRe = ar * op->re;
+    *outIm = ai * op->re;
+    break;
+  case OP_NEG:
+    *outRe = -ar;
+    *outIm = -ai;
+    break;
+  case OP_CONJ:
+    *outRe = ar;
+    *outIm = -ai;
+    break;
+  case OP_FOLD:
+    *outRe = fabs(ar);
+    *outIm = fabs(ai);
+    break;
+  }
+}
+
+static char constant(const Parser *p, int v) {
+  return v >= 2 && p->ops[v - 2].kind == OP_CONST;
+}
+
+/* Appends an operation, folding it if every operand is constant. Returns
+ * its value or -1. */
+static int emit(Parser *p, uint8_t kind, int a, int b, double re,
+                double im) {
+  FormulaOp op = {kind, a, b, re, im};
+  double values[2][MAX_OPS + 2] = {{0}};
+
+  if (a < 0 || b < 0)
+    return -1;
+
+  if (kind != OP_CONST && constant(p, a) && constant(p, b)) {
+    values[0][a] = p->ops[a - 2].re;
+    values[1][a] = p->ops[a - 2].im;
+    values[0][b] = p->ops[b - 2].re;
+    values[1][b] = p->ops[b - 2].im;
+    evaluate(&op, values[0], values[1], &op.re, &op.im);
+    op.kind = OP_CONST;
+    op.a = op.b = 0;
+  }
+
+  /* A product with a real constant needs two multiplications. */
+  if (kind == OP_MUL && op.kind == OP_MUL) {
+    if (constant(p, b) && p->ops[b - 2].im == 0.0)
+      op = (FormulaOp){OP_SCALE, a, a, p->ops[b - 2].re, 0.0};
+    else if (constant(p, a) && p->ops[a - 2].im == 0.0)
+      op = (FormulaOp){OP_SCALE, b, b, p->ops[a - 2].re, 0.0};
+  }
+
+  if (p->count == MAX_OPS) {
+    p->error = "formula too long";
+    return -1;
+  }
+
+  p->ops[p->count] = op;
+  return (int)p->count++ + 2;
+}
+
+static void skip(Parser *p) {
+  while (isspace((unsigned char)*p->at))
+    p->at++;
+}
+
+static char accept(Parser *p, char c) {
+  skip(p);
+  if (*p->at != c)
+    return 0;
+  p->at++;
+  return 1;
+}
+
+static int expression(Parser *p);
+
+static int call(Parser *p, uint8_t kind) {
+  int a;
+
+  if (!accept(p, '(')) {
+    p->error = "expected (";
+    return -1;
+  }
+
+  a = expression(p);
+  if (a >= 0 && !accept(p, ')')) {
+    p->error = "expected )";
+    return -1;
+  }
+
+  return emit(p, kind, a, a, 0.0, 0.0);
+}
+
+static int primary(Parser *p) {
+  const char *start;
+  char *end;
+  double value;
+  int v;
+
+  skip(p);
+  start = p->at;
+
+  if (accept(p, '(')) {
+    v = expression(p);
+    if (v >= 0 && !accept(p, ')')) {
+      p->error = "expected )";
+      return -1;
+    }
+    return v;
+  }
+
+  if (isdigit((unsigned char)*start) || *start == '.') {
+    value = strtod(start, &end);
+    p->at = end;
+    return emit(p, OP_CONST, 0, 0, value, 0.0);
+  }
+
+  while (isalpha((unsigned char)*p->at))
+    p->at++;
+
+#define WORD(w)                                                                \
+  (p->at - start == sizeof(w) - 1 && !strncmp(start, w, sizeof(w) - 1))
+  if (WORD("z"))
+    return 0;
+  if (WORD("c"))
+    return 1;
+  if (WORD("i"))
+    return emit(p, OP_CONST, 0, 0, 0.0, 1.0);
+  if (WORD("conj"))
+    return call(p, OP_CONJ);
+  if (WORD("fold"))
+    return call(p, OP_FOLD);
+#undef WORD
+
+  p->error = p->at == start ? "expected a value" : "unknown name";
+  p->at = start;
+  return -1;
+}
+
+/* a^n by squaring. */
+static int power(Parser *p) {
+  int base = primary(p), result = -1;
+  long n;
+  char *end;
+
+  if (base < 0 || !accept(p, '^'))
+    return base;
+
+  skip(p);
+  n = strtol(p->at, &end, 10);
+  if (end == p->at || n < 0 || n > MAX_POWER) {
+    p->error = "expected a power from 0 to 64";
+    return -1;
+  }
+  p->at = end;
+
+  if (!n)
+    return emit(p, OP_CONST, 0, 0, 1.0, 0.0);
+
+  for (;;) {
+    if (n & 1)
+      result = result < 0 ? base : emit(p, OP_MUL, result, base, 0.0, 0.0);
+    n >>= 1;
+    if (!n)
+      return result;
+    base = emit(p, OP_SQR, base, base, 0.0, 0.0);
+  }
+}
+
+static int unary(Parser *p) {
+  int a;
+
+  if (!accept(p, '-'))
+    return power(p);
+
+  a = unary(p);
+  return emit(p, OP_NEG, a, a, 0.0, 0.0);
+}
+
+static int term(Parser *p) {
+  int a = unary(p);
+
+  for (;;) {
+    if (accept(p, '*'))
+      a = emit(p, OP_MUL, a, unary(p), 0.0, 0.0);
+    else if (accept(p, '/'))
+      a = emit(p, OP_DIV, a, unary(p), 0.0, 0.0);
+    else
+      return a;
+  }
+}
+
+static int expression(Parser *p) {
+  int a = term(p);
+
+  for (;;) {
+    if (accept(p, '+'))
+      a = emit(p, OP_ADD, a, term(p), 0.0, 0.0);
+    else if (accept(p, '-'))
+      a = emit(p, OP_SUB, a, term(p), 0.0, 0.0);
+    else
+      return a;
+  }
+}
+
+/* Drops what constant folding left unused and numbers the rest again, the
+ * last operation stays last. */
+static unsigned int compact(FormulaOp *ops, unsigned int count) {
+  char used[MAX_OPS + 2] = {0};
+  uint8_t renumbered[MAX_OPS + 2] = {0, 1};
+  unsigned int kept = 0;
+
+  used[count + 1] = 1;
+  for (unsigned int i = count; i-- > 0;)
+    if (used[i + 2])
+      used[ops[i].a] = used[ops[i].b] = 1;
+
+  for (unsigned int i = 0; i < count; i++) {
+    if (!used[i + 2])
+      continue;
+
+    ops[kept] = ops[i];
+    ops[kept].a = renumbered[ops[i].a];
+    ops[kept].b = renumbered[ops[i].b];
+    renumbered[i + 2] = kept++ + 2;
+  }
+
+  return kept;
+}
+
+/* The custom formula for CPUs without a JIT, same signature. */
+static uint32_t interpret(double zx, double zy, double cx, double cy,
+                          uint32_t limit) {
+  double re[MAX_OPS + 2], im[MAX_OPS + 2];
+  uint32_t it = 0;
+
+  re[1] = cx;
+  im[1] = cy;
+
+  while (zx * zx + zy * zy <= 4.0 && it < limit) {
+    re[0] = zx;
+    im[0] = zy;
+    for (unsigned int i = 0; i < custom.count; i++)
+      evaluate(&custom.ops[i], re, im, &re[i + 2], &im[i + 2]);
+    zx = re[custom.count + 1];
+    zy = im[custom.count + 1];
+    it++;
+  }
+
+  return it;
+}
+
+/* formula() for formula.glsl, one local per value. */
+static char glsl(const FormulaOp *ops, unsigned int count, char *out,
+                 size_t size) {
+  size_t length;
+  int n;
+
+  n = snprintf(out, size,
+               "\ndvec2 formula(dvec2 z, dvec2 c) {\n"
+               "  dvec2 v0 = z, v1 = c;\n");
+
+  for (unsigned int i = 0; i < count && n > 0 && (size_t)n < size; i++) {
+    const FormulaOp *op = &ops[i];
+    unsigned int v = i + 2, a = op->a, b = op->b;
+
+    length = n;
+    switch (op->kind) {
+    case OP_CONST:
+      n = snprintf(out + length, size - length,
+                   "  dvec2 v%u = dvec2(%.17elf, %.17elf);\n", v, op->re,
+                   op->im);
+      break;
+    case OP_ADD:
+      n = snprintf(out + length, size - length, "  dvec2 v%u = v%u + v%u;\n",
+                   v, a, b);
+      break;
+    case OP_SUB:
+      n = snprintf(out + length, size - length, "  dvec2 v%u = v%u - v%u;\n",
+                   v, a, b);
+      break;
+    case OP_MUL:
+      n = snprintf(out + length, size - length,
+                   "  dvec2 v%u = complexMul(v%u, v%u);\n", v, a, b);
+      break;
+    case OP_DIV:
+      n = snprintf(out + length, size - length,
+                   "  dvec2 v%u = dvec2(dot(v%u, v%u), v%u.y * v%u.x - "
+                   "v%u.x * v%u.y) / dot(v%u, v%u);\n",
+                   v, a, b, a, b, a, b, b, b);
+      break;
+    case OP_SQR:
+      n = snprintf(out + length, size - length,
+                   "  dvec2 v%u = complexSquared(v%u);\n", v, a);
+      break;
+    case OP_SCALE:
+      n = snprintf(out + length, size - length,
+                   "  dvec2 v%u = v%u * %.17elf;\n", v, a, op->re);
+      break;
+    case OP_NEG:
+      n = snprintf(out + length, size - length, "  dvec2 v%u = -v%u;\n", v,
+                   a);
+      break;
+    case OP_CONJ:
+      n = snprintf(out + length, size - length,
+                   "  dvec2 v%u = dvec2(v%u.x, -v%u.y);\n", v, a, a);
+      break;
+    case OP_FOLD:
+      n = snprintf(out + length, size - length, "  dvec2 v%u = abs(v%u);\n",
+                   v, a);
+      break;
+    }
+    n = n < 0 ? n : n + (int)length;
+  }
+
+  if (n > 0 && (size_t)n < size) {
+    length = n;
+    n = snprintf(out + length, size - length, "  return v%u;\n}\n",
+                 count + 1);
+    n = n < 0 ? n : n + (int)length;
+  }
+
+  return n > 0 && (size_t)n < size;
+}
+
+/* FNV-1a of the operations, so tiles of different formulas never share a
+ * key. */
+static uint32_t hash(const FormulaOp *ops, unsigned int count) {
+  uint64_t h = 0xcbf29ce484222325ull;
+
+  for (unsigned int i = 0; i < count; i++) {
+    unsigned char bytes[3 + 2 * sizeof(double)];
+
+    bytes[0] = ops[i].kind;
+    bytes[1] = ops[i].a;
+    bytes[2] = ops[i].b;
+    memcpy(bytes + 3, &ops[i].re, sizeof(double));
+    memcpy(bytes + 3 + sizeof(double), &ops[i].im, sizeof(double));
+
+    for (size_t k = 0; k < sizeof(bytes); k++)
+      h = (h ^ bytes[k]) * 0x100000001b3ull;
+  }
+
+  return (uint32_t)(h ^ h >> 32);
+}
+
+char formulaCompile(const char *source, uint32_t *formula) {
+  Parser p = {.at = source};
+  int result = expression(&p);
+
+  skip(&p);
+  if (result >= 0 && *p.at)
+    p.error = "unexpected text";
+
+  if (result < 0 || p.error) {
+    fprintf(stderr, "[Error] Formula: %s at '%.16s'\n",
+            p.error ? p.error : "bad expression", p.at);
+    return 0;
+  }
+
+  /* The loop takes the last value as the next z. */
+  if (result != (int)p.count + 1)
+    emit(&p, OP_SCALE, result, result, 1.0, 0.0);
+  p.count = compact(p.ops, p.count);
+
+  if (p.error || strlen(source) >= sizeof(custom.source) ||
+      !glsl(p.ops, p.count, custom.glsl, sizeof(custom.glsl))) {
+    fprintf(stderr, "[Error] Formula: too long\n");
+    return 0;
+  }
+
+  jitFree(custom.loop != interpret ? custom.loop : NULL);
+  memcpy(custom.ops, p.ops, sizeof(p.ops));
+  custom.count = p.count;
+  strcpy(custom.source, source);
+  custom.formula = FORMULA_CUSTOM | (hash(p.ops, p.count) & 0xffffff) << 8;
+
+  custom.loop = jitCompile(p.ops, p.count);
+  if (!custom.loop) {
+    puts("[Info] Interpreting the custom formula");
+    custom.loop = interpret;
+  }
+
+  *formula = custom.formula;
+  return 1;
+}
+
+char formulaLoad(const char *path, uint32_t *formula) {
+  char source[MAX_SOURCE] = "", *comment;
+  size_t length = 0;
+  FILE *fp = fopen(path, "r");
+
+  if (!fp) {
+    fprintf(stderr, "[Error] Unable to read %s\n", path);
+    return 0;
+  }
+
+  /* Lines are joined, '#' comments run to their end. */
+  while (length < sizeof(source) - 1 &&
+         fgets(source + length, sizeof(source) - length, fp)) {
+    comment = strchr(source + length, '#');
+    if (comment)
+      strcpy(comment, "\n");
+    length += strlen(source + length);
+  }
+
+  fclose(fp);
+  return formulaCompile(source, formula);
+}
+
+const char *formulaGLSL(uint32_t formula) {
+  return formula == custom.formula && custom.formula ? custom.glsl : NULL;
+}
+
+FormulaLoop formulaLoop(uint32_t formula) {
+  return formula == custom.formula && custom.formula ? custom.loop : NULL;
+}
+
+const char *formulaSource(uint32_t formula) {
+  return formula == custom.formula && custom.formula ? custom.source : NULL;
+}
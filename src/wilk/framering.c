@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include <wilk/framering.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+_Static_assert(sizeof(FrameRingHeader) == 64, "ring header must fill a line");
+_Static_assert(sizeof(FrameHeader) == 128, "frame header must fill lines");
+
+struct FrameRing {
+  char name[256];
+  FrameRingHeader *header;
+  size_t size;
+  FrameHeader *writing;
+  uint64_t frame;
+};
+
+static size_t ringSize(const FrameRingHeader *header) {
+  return sizeof(FrameRingHeader) + header->slots * header->slotSize;
+}
+
+FrameRing *frameRingCreate(const char *name, uint32_t maxWidth,
+                           uint32_t maxHeight, uint32_t slots) {
+  FrameRingHeader header = {0};
+  FrameRing *ring;
+  int fd;
+
+  if (strlen(name) >= sizeof(ring->name) || slots < 2)
+    return NULL;
+
+  header.magic = FRAME_RING_MAGIC;
+  header.version = FRAME_RING_VERSION;
+  header.slots = slots;
+  header.maxWidth = maxWidth;
+  header.maxHeight = maxHeight;
+  /* Keep every slot cache line aligned, see the headers. */
+  header.slotSize =
+      (sizeof(FrameHeader) + (uint64_t)maxWidth * maxHeight * 4 + 63) & ~63ULL;
+
+  ring = calloc(1, sizeof(*ring));
+  if (!ring)
+    return NULL;
+
+  strcpy(ring->name, name);
+  ring->size = ringSize(&header);
+
+  fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0 || ftruncate(fd, ring->size) != 0) {
+    fprintf(stderr, "[Error] Unable to create shared memory %s\n", name);
+    if (fd >= 0) {
+      close(fd);
+      shm_unlink(name);
+    }
+    free(ring);
+    return NULL;
+  }
+
+  ring->header =
+      mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (ring->header == MAP_FAILED) {
+    shm_unlink(name);
+    free(ring);
+    return NULL;
+  }
+
+  /* Consumers check the magic, write it last. */
+  header.magic = 0;
+  memcpy(ring->header, &header, sizeof(header));
+  __atomic_store_n(&ring->header->magic, FRAME_RING_MAGIC, __ATOMIC_RELEASE);
+  return ring;
+}
+
+void frameRingDestroy(FrameRing *ring) {
+  if (!ring)
+    return;
+
+  munmap(ring->header, ring->size);
+  shm_unlink(ring->name);
+  free(ring);
+}
+
+void *frameRingBegin(FrameRing *ring, uint32_t width, uint32_t height) {
+  FrameHeader *frame;
+
+  if (width > ring->header->maxWidth || height > ring->header->maxHeight)
+    return NULL;
+
+  ring->frame++;
+  frame = FRAME_RING_SLOT(ring->header, ring->frame);
+
+  /* Odd while writing, readers of the previous frame in this slot notice. */
+  __atomic_store_n(&frame->sequence, 2 * ring->frame - 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  frame->width = width;
+  frame->height = height;
+  frame->stride = width * 4;
+  ring->writing = frame;
+  return frame + 1;
+}
+
+void frameRingPublish(FrameRing *ring, const View *view) {
+  FrameHeader *frame = ring->writing;
+  struct timespec ts;
+
+  if (!frame)
+    return;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  frame->timestamp = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  frame->kernel = view->kernel;
+  frame->x = view->x;
+  frame->y = view->y;
+  frame->scale = view->scale;
+  frame->maxIterations = view->maxIterations;
+  frame->formula = view->formula;
+  frame->julia = view->julia;
+  frame->cx = view->cx;
+  frame->cy = view->cy;
+
+  __atomic_store_n(&frame->sequence, 2 * ring->frame, __ATOMIC_RELEASE);
+  __atomic_store_n(&ring->header->published, ring->frame, __ATOMIC_RELEASE);
+  ring->writing = NULL;
+}
+
+char frameRingOpen(const char *name, FrameRingMap *map) {
+  FrameRingHeader *header;
+  struct stat st;
+  int fd;
+
+  fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0)
+    return 0;
+
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header)) {
+    close(fd);
+    return 0;
+  }
+
+  header = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (header == MAP_FAILED)
+    return 0;
+
+  if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != FRAME_RING_MAGIC ||
+      header->version != FRAME_RING_VERSION ||
+      ringSize(header) > (size_t)st.st_size) {
+    munmap(header, st.st_size);
+    return 0;
+  }
+
+  /* A new producer may resize the ring, unmap what was mapped. */
+  map->header = header;
+  map->size = st.st_size;
+  return 1;
+}
+
+void frameRingClose(FrameRingMap *map) {
+  if (map->header)
+    munmap((void *)map->header, map->size);
+  map->header = NULL;
+}
+
+const FrameHeader *frameRingLatest(const FrameRingHeader *header,
+                                   uint64_t *sequence) {
+  uint64_t n = __atomic_load_n(&header->published, __ATOMIC_ACQUIRE);
+  const FrameHeader *frame;
+
+  if (!n)
+    return NULL;
+
+  frame = FRAME_RING_SLOT(header, n);
+  *sequence = 2 * n;
+
+  if (__atomic_load_n(&frame->sequence, __ATOMIC_ACQUIRE) != *sequence)
+    return NULL;
+
+  return frame;
+}
+
+char frameRingValid(const FrameHeader *frame, uint64_t sequence) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&frame->sequence, __ATOMIC_RELAXED) == sequence;
+}
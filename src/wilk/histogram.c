@@ -0,0 +1,112 @@
+#include <wilk/histogram.h>
+#include <wilk/shader.h>
+
+#include <stddef.h>
+#include <string.h>
+
+char histogramInit(Histogram *histogram) {
+  histogram->histogramProgram = computeProgram("src/shader/histogram.comp");
+  histogram->cdfProgram = computeProgram("src/shader/cdf.comp");
+
+  if (!histogram->histogramProgram || !histogram->cdfProgram) {
+    histogramDestroy(histogram);
+    return 0;
+  }
+
+  glGenBuffers(1, &histogram->bins);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, histogram->bins);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, HISTOGRAM_BINS * sizeof(GLuint), NULL,
+               GL_DYNAMIC_COPY);
+
+  glGenBuffers(1, &histogram->stats);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, histogram->stats);
+  glBufferData(GL_COPY_WRITE_BUFFER, HISTOGRAM_BINS * sizeof(GLuint), NULL,
+               GL_STREAM_READ);
+
+  glGenTextures(1, &histogram->cdf);
+  glBindTexture(GL_TEXTURE_1D, histogram->cdf);
+  glTexImage1D(GL_TEXTURE_1D, 0, GL_R32F, HISTOGRAM_BINS, 0, GL_RED, GL_FLOAT,
+               NULL);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  return 1;
+}
+
+void histogramDestroy(Histogram *histogram) {
+  glDeleteProgram(histogram->histogramProgram);
+  glDeleteProgram(histogram->cdfProgram);
+  glDeleteBuffers(1, &histogram->bins);
+  glDeleteTextures(1, &histogram->cdf);
+  glDeleteBuffers(1, &histogram->stats);
+  if (histogram->statsFence)
+    glDeleteSync(histogram->statsFence);
+
+  histogram->histogramProgram = 0;
+  histogram->cdfProgram = 0;
+  histogram->bins = 0;
+  histogram->cdf = 0;
+  histogram->stats = 0;
+  histogram->statsFence = NULL;
+}
+
+void histogramUpdate(Histogram *histogram, GLuint iterations, GLuint width,
+                     GLuint height, double maxIterations) {
+  GLuint zero = 0;
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, histogram->bins);
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                    GL_UNSIGNED_INT, &zero);
+
+  glUseProgram(histogram->histogramProgram);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, iterations);
+  glUniform1i(glGetUniformLocation(histogram->histogramProgram, "iterations"),
+              0);
+  glUniform1f(
+      glGetUniformLocation(histogram->histogramProgram, "maxIterations"),
+      maxIterations);
+  glUniform2i(glGetUniformLocation(histogram->histogramProgram, "size"),
+              width, height);
+  glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+  glUseProgram(histogram->cdfProgram);
+  glBindImageTexture(0, histogram->cdf, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                     GL_R32F);
+  glDispatchCompute(1, 1, 1);
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+char histogramRequest(Histogram *histogram) {
+  if (!histogram->stats || histogram->statsFence)
+    return 0;
+
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  glBindBuffer(GL_COPY_READ_BUFFER, histogram->bins);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, histogram->stats);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                      HISTOGRAM_BINS * sizeof(GLuint));
+  histogram->statsFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  return 1;
+}
+
+char histogramCollect(Histogram *histogram, uint32_t *bins) {
+  const void *data;
+
+  if (!histogram->statsFence ||
+      glClientWaitSync(histogram->statsFence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    return 0;
+
+  glDeleteSync(histogram->statsFence);
+  histogram->statsFence = NULL;
+
+  glBindBuffer(GL_COPY_READ_BUFFER, histogram->stats);
+  data = glMapBufferRange(GL_COPY_READ_BUFFER, 0,
+                          HISTOGRAM_BINS * sizeof(GLuint), GL_MAP_READ_BIT);
+  if (!data)
+    return 0;
+
+  memcpy(bins, data, HISTOGRAM_BINS * sizeof(GLuint));
+  glUnmapBuffer(GL_COPY_READ_BUFFER);
+  return 1;
+}
@@ -0,0 +1,93 @@
+#include <wilk/arena.h>
+#include <wilk/image.h>
+#include <wilk/kernel.h>
+
+#include <math.h>
+#include <stdio.h>
+
+static unsigned char shade(const TileKey *key, float value) {
+  double t;
+
+  if (key->kernel == KERNEL_DISTANCE)
+    t = value > 0.0f ? pow(fmin(value / DISTANCE_FAR, 1.0), 0.35) : 0.0;
+  else
+    t = value / key->maxIterations;
+
+  return (unsigned char)(fmin(fmax(t, 0.0), 1.0) * 255.0 + 0.5);
+}
+
+char imageWritePPM(const char *path, const TileKey *key, const float *data) {
+  Arena *arena = arenaThread();
+  ArenaMark mark = arenaMark(arena);
+  unsigned char *row;
+  FILE *fp;
+  char ok = 1;
+
+  fp = fopen(path, "wb");
+  if (!fp)
+    return 0;
+
+  row = arenaAlloc(arena, (size_t)key->width * 3);
+  if (!row) {
+    fclose(fp);
+    return 0;
+  }
+
+  fprintf(fp, "P6\n%u %u\n255\n", key->width, key->height);
+
+  /* Row 0 of a tile is the bottom of the image. */
+  for (uint32_t j = key->height; j-- > 0 && ok;) {
+    for (uint32_t i = 0; i < key->width; i++) {
+      unsigned char t = shade(key, data[(size_t)j * key->width + i]);
+
+      row[i * 3 + 0] = t;
+      row[i * 3 + 1] = 0;
+      row[i * 3 + 2] = t;
+    }
+
+    ok = fwrite(row, 3, key->width, fp) == key->width;
+  }
+
+  arenaRewind(arena, mark);
+  return fclose(fp) == 0 && ok;
+}
+
+char imageWriteFrame(FILE *fp, uint32_t width, uint32_t height,
+                     const unsigned char *pixels) {
+  Arena *arena = arenaThread();
+  ArenaMark mark = arenaMark(arena);
+  unsigned char *row = arenaAlloc(arena, (size_t)width * 3);
+  char ok;
+
+  if (!row)
+    return 0;
+
+  ok = fprintf(fp, "P6\n%u %u\n255\n", width, height) > 0;
+
+  for (uint32_t j = height; j-- > 0 && ok;) {
+    const unsigned char *src = pixels + (size_t)j * width * 4;
+
+    for (uint32_t i = 0; i < width; i++) {
+      row[i * 3 + 0] = src[i * 4 + 0];
+      row[i * 3 + 1] = src[i * 4 + 1];
+      row[i * 3 + 2] = src[i * 4 + 2];
+    }
+
+    ok = fwrite(row, 3, width, fp) == width;
+  }
+
+  arenaRewind(arena, mark);
+  return ok;
+}
+
+char imageWriteRGBA(const char *path, uint32_t width, uint32_t height,
+                    const unsigned char *pixels) {
+  FILE *fp = fopen(path, "wb");
+  char ok;
+
+  if (!fp)
+    return 0;
+
+  ok = imageWriteFrame(fp, width, height, pixels);
+  return fclose(fp) == 0 && ok;
+}
@@ -0,0 +1,419 @@
+#include <wilk/jit.h>
+
+#include <stddef.h>
+
+#if defined(__x86_64__)
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define CODE_CAPACITY 4096
+#define MAX_SLOTS 64
+#define MAX_JUMPS 4
+/* The mapping starts with its size, code follows at this offset. */
+#define HEADER 16
+
+/* Registers: z lives in xmm0/xmm1 and c in xmm2/xmm3, every other value
+ * gets one of the pairs in between and xmm14/xmm15 are scratch. */
+#define Z 0
+#define C 2
+#define FIRST_PAIR 4
+#define PAIRS 5
+#define S0 14
+#define S1 15
+
+/* Constant pool slots of 16 bytes, the masks must be aligned for andpd and
+ * xorpd. */
+#define SLOT_FOUR 0
+#define SLOT_SIGN 1
+#define SLOT_ABS 2
+
+/* SSE2 opcodes after the 0x0f escape. */
+#define MOVSD 0x10 /* F2 */
+#define MOVAPD 0x28 /* 66 */
+#define ANDPD 0x54 /* 66 */
+#define XORPD 0x57 /* 66 */
+#define ADDSD 0x58 /* F2 */
+#define MULSD 0x59 /* F2 */
+#define SUBSD 0x5c /* F2 */
+#define DIVSD 0x5e /* F2 */
+#define UCOMISD 0x2e /* 66 */
+
+typedef struct {
+  unsigned char code[CODE_CAPACITY];
+  size_t size;
+  char overflow;
+
+  uint64_t pool[2 * MAX_SLOTS];
+  unsigned int slots;
+  /* disp32 fields pointing into the pool, patched once the code is done */
+  size_t fixupAt[4 * MAX_SLOTS + 8];
+  unsigned int fixupTarget[4 * MAX_SLOTS + 8];
+  unsigned int fixups;
+} Emitter;
+
+static void byte(Emitter *e, unsigned char b) {
+  if (e->size < CODE_CAPACITY)
+    e->code[e->size++] = b;
+  else
+    e->overflow = 1;
+}
+
+static void word(Emitter *e, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    byte(e, value >> (8 * i));
+}
+
+static void patch(Emitter *e, size_t at, uint32_t value) {
+  if (at + 4 <= e->size)
+    for (int i = 0; i < 4; i++)
+      e->code[at + i] = value >> (8 * i);
+}
+
+static unsigned int slot(Emitter *e, double lo, double hi) {
+  if (e->slots == MAX_SLOTS) {
+    e->overflow = 1;
+    return 0;
+  }
+
+  memcpy(&e->pool[2 * e->slots], &lo, sizeof(lo));
+  memcpy(&e->pool[2 * e->slots + 1], &hi, sizeof(hi));
+  return e->slots++;
+}
+
+static void prefix(Emitter *e, unsigned char mandatory, int reg, int rm) {
+  byte(e, mandatory);
+  if (reg >= 8 || rm >= 8)
+    byte(e, 0x40 | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0));
+  byte(e, 0x0f);
+}
+
+/* op reg, rm between two xmm registers. */
+static void sse(Emitter *e, unsigned char mandatory, unsigned char op, int reg,
+                int rm) {
+  prefix(e, mandatory, reg, rm);
+  byte(e, op);
+  byte(e, 0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* op reg, [rip + pool slot], half selects the upper double. */
+static void ssePool(Emitter *e, unsigned char mandatory, unsigned char op,
+                    int reg, unsigned int s, int half) {
+  prefix(e, mandatory, reg, 0);
+  byte(e, op);
+  byte(e, 0x05 | (reg & 7) << 3);
+
+  if (e->fixups < sizeof(e->fixupAt) / sizeof(e->fixupAt[0])) {
+    e->fixupAt[e->fixups] = e->size;
+    e->fixupTarget[e->fixups++] = 16 * s + 8 * half;
+  } else {
+    e->overflow = 1;
+  }
+  word(e, 0);
+}
+
+static void mov(Emitter *e, int dst, int src) {
+  if (dst != src)
+    sse(e, 0x66, MOVAPD, dst, src);
+}
+
+static void arith(Emitter *e, unsigned char op, int dst, int src) {
+  sse(e, 0xf2, op, dst, src);
+}
+
+/* dst = a op b for both halves. */
+static void pairwise(Emitter *e, unsigned char op, int d, int a, int b) {
+  mov(e, d, a);
+  arith(e, op, d, b);
+  mov(e, d + 1, a + 1);
+  arith(e, op, d + 1, b + 1);
+}
+
+/* d = a * b, also for a == b. */
+static void multiply(Emitter *e, int d, int a, int b) {
+  mov(e, d, a);
+  arith(e, MULSD, d, b);
+  mov(e, S0, a + 1);
+  arith(e, MULSD, S0, b + 1);
+  arith(e, SUBSD, d, S0);
+
+  mov(e, d + 1, a);
+  arith(e, MULSD, d + 1, b + 1);
+  mov(e, S0, a + 1);
+  arith(e, MULSD, S0, b);
+  arith(e, ADDSD, d + 1, S0);
+}
+
+/* (a.re b.re + a.im b.im, a.im b.re - a.re b.im) / |b|^2 */
+static void divide(Emitter *e, int d, int a, int b) {
+  mov(e, S1, b);
+  arith(e, MULSD, S1, b);
+  mov(e, S0, b + 1);
+  arith(e, MULSD, S0, b + 1);
+  arith(e, ADDSD, S1, S0);
+
+  mov(e, d, a);
+  arith(e, MULSD, d, b);
+  mov(e, S0, a + 1);
+  arith(e, MULSD, S0, b + 1);
+  arith(e, ADDSD, d, S0);
+  arith(e, DIVSD, d, S1);
+
+  mov(e, d + 1, a + 1);
+  arith(e, MULSD, d + 1, b);
+  mov(e, S0, a);
+  arith(e, MULSD, S0, b + 1);
+  arith(e, SUBSD, d + 1, S0);
+  arith(e, DIVSD, d + 1, S1);
+}
+
+static void operation(Emitter *e, const FormulaOp *op, int d, int a, int b) {
+  unsigned int s;
+
+  switch (op->kind) {
+  case OP_ADD:
+    pairwise(e, ADDSD, d, a, b);
+    break;
+  case OP_SUB:
+    pairwise(e, SUBSD, d, a, b);
+    break;
+  case OP_MUL:
+    multiply(e, d, a, b);
+    break;
+  case OP_SQR:
+    /* One product less than a * a. */
+    mov(e, d, a);
+    arith(e, MULSD, d, a);
+    mov(e, S0, a + 1);
+    arith(e, MULSD, S0, a + 1);
+    arith(e, SUBSD, d, S0);
+    mov(e, d + 1, a);
+    arith(e, MULSD, d + 1, a + 1);
+    arith(e, ADDSD, d + 1, d + 1);
+    break;
+  case OP_DIV:
+    divide(e, d, a, b);
+    break;
+  case OP_SCALE:
+    s = slot(e, op->re, 0.0);
+    mov(e, d, a);
+    ssePool(e, 0xf2, MULSD, d, s, 0);
+    mov(e, d + 1, a + 1);
+    ssePool(e, 0xf2, MULSD, d + 1, s, 0);
+    break;
+  case OP_NEG:
+    mov(e, d, a);
+    ssePool(e, 0x66, XORPD, d, SLOT_SIGN, 0);
+    mov(e, d + 1, a + 1);
+    ssePool(e, 0x66, XORPD, d + 1, SLOT_SIGN, 0);
+    break;
+  case OP_CONJ:
+    mov(e, d, a);
+    mov(e, d + 1, a + 1);
+    ssePool(e, 0x66, XORPD, d + 1, SLOT_SIGN, 0);
+    break;
+  case OP_FOLD:
+    mov(e, d, a);
+    ssePool(e, 0x66, ANDPD, d, SLOT_ABS, 0);
+    mov(e, d + 1, a + 1);
+    ssePool(e, 0x66, ANDPD, d + 1, SLOT_ABS, 0);
+    break;
+  }
+}
+
+/* Assigns register pairs to values, constants for the whole loop and the
+ * rest from their definition to their last use. Returns 0 if there are not
+ * enough. */
+static char allocate(const FormulaOp *ops, unsigned int count, int *reg) {
+  int lastUse[256 + 2], owner[PAIRS];
+  unsigned int result = count + 1;
+
+  for (unsigned int v = 0; v < count + 2; v++)
+    lastUse[v] = -1;
+  for (unsigned int i = 0; i < count; i++) {
+    lastUse[ops[i].a] = i;
+    lastUse[ops[i].b] = i;
+  }
+  lastUse[result] = count;
+
+  for (int p = 0; p < PAIRS; p++)
+    owner[p] = -1;
+
+  reg[0] = Z;
+  reg[1] = C;
+
+  for (unsigned int i = 0; i < count; i++) {
+    unsigned int v = i + 2;
+    int p;
+
+    if (ops[i].kind != OP_CONST)
+      continue;
+    for (p = 0; p < PAIRS && owner[p] >= 0; p++)
+      ;
+    if (p == PAIRS)
+      return 0;
+    owner[p] = v;
+    reg[v] = FIRST_PAIR + 2 * p;
+  }
+
+  for (unsigned int i = 0; i < count; i++) {
+    unsigned int v = i + 2;
+    int p;
+
+    if (ops[i].kind == OP_CONST)
+      continue;
+
+    /* Operands stay put until the result is written. */
+    for (p = 0; p < PAIRS && owner[p] >= 0; p++)
+      ;
+    if (p == PAIRS)
+      return 0;
+    owner[p] = v;
+    reg[v] = FIRST_PAIR + 2 * p;
+
+    for (p = 0; p < PAIRS; p++) {
+      int o = owner[p];
+
+      if (o >= 2 && ops[o - 2].kind != OP_CONST && lastUse[o] <= (int)i &&
+          (unsigned int)o != result)
+        owner[p] = -1;
+    }
+  }
+
+  return 1;
+}
+
+FormulaLoop jitCompile(const FormulaOp *ops, unsigned int count) {
+  static const uint64_t sign = 0x8000000000000000ull, abs = ~sign;
+  Emitter *e;
+  int reg[256 + 2];
+  size_t loop, jumps[MAX_JUMPS], poolAt, size;
+  unsigned int jumpCount = 0, result = count + 1;
+  unsigned char *mapping;
+  FormulaLoop entry;
+  void *code;
+
+  if (!count || count > 253 || !allocate(ops, count, reg))
+    return NULL;
+
+  e = calloc(1, sizeof(*e));
+  if (!e)
+    return NULL;
+
+  slot(e, 4.0, 0.0);
+  e->pool[2 * SLOT_SIGN] = e->pool[2 * SLOT_SIGN + 1] = sign;
+  e->pool[2 * SLOT_ABS] = e->pool[2 * SLOT_ABS + 1] = abs;
+  e->slots = 3;
+
+  /* Constants are loaded once. */
+  for (unsigned int i = 0; i < count; i++) {
+    if (ops[i].kind == OP_CONST) {
+      unsigned int s = slot(e, ops[i].re, ops[i].im);
+
+      ssePool(e, 0xf2, MOVSD, reg[i + 2], s, 0);
+      ssePool(e, 0xf2, MOVSD, reg[i + 2] + 1, s, 1);
+    }
+  }
+
+  /* xor eax, eax */
+  byte(e, 0x31);
+  byte(e, 0xc0);
+  loop = e->size;
+
+  /* Leave once |z|^2 > 4 (or NaN), as in escapeTime(). */
+  mov(e, S0, Z);
+  arith(e, MULSD, S0, Z);
+  mov(e, S1, Z + 1);
+  arith(e, MULSD, S1, Z + 1);
+  arith(e, ADDSD, S0, S1);
+  ssePool(e, 0xf2, MOVSD, S1, SLOT_FOUR, 0);
+  sse(e, 0x66, UCOMISD, S1, S0);
+  /* jb done */
+  byte(e, 0x0f);
+  byte(e, 0x82);
+  jumps[jumpCount++] = e->size;
+  word(e, 0);
+
+  /* cmp eax, edi; jae done */
+  byte(e, 0x39);
+  byte(e, 0xf8);
+  byte(e, 0x0f);
+  byte(e, 0x83);
+  jumps[jumpCount++] = e->size;
+  word(e, 0);
+
+  for (unsigned int i = 0; i < count; i++)
+    if (ops[i].kind != OP_CONST)
+      operation(e, &ops[i], reg[i + 2], reg[ops[i].a], reg[ops[i].b]);
+
+  mov(e, Z, reg[result]);
+  mov(e, Z + 1, reg[result] + 1);
+
+  /* add eax, 1; jmp loop */
+  byte(e, 0x83);
+  byte(e, 0xc0);
+  byte(e, 0x01);
+  byte(e, 0xe9);
+  word(e, (uint32_t)(loop - (e->size + 4)));
+
+  for (unsigned int i = 0; i < jumpCount; i++)
+    patch(e, jumps[i], (uint32_t)(e->size - (jumps[i] + 4)));
+  /* ret */
+  byte(e, 0xc3);
+
+  poolAt = (e->size + 15) & ~(size_t)15;
+  for (unsigned int i = 0; i < e->fixups; i++)
+    patch(e, e->fixupAt[i],
+          (uint32_t)(poolAt + e->fixupTarget[i] - (e->fixupAt[i] + 4)));
+
+  size = HEADER + poolAt + 16 * e->slots;
+  mapping = e->overflow ? MAP_FAILED
+                        : mmap(NULL, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) {
+    free(e);
+    return NULL;
+  }
+
+  memcpy(mapping, &size, sizeof(size));
+  memcpy(mapping + HEADER, e->code, e->size);
+  memcpy(mapping + HEADER + poolAt, e->pool, 16 * e->slots);
+  free(e);
+
+  if (mprotect(mapping, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(mapping, size);
+    return NULL;
+  }
+
+  /* ISO C has no cast from data to code pointers. */
+  code = mapping + HEADER;
+  memcpy(&entry, &code, sizeof(entry));
+  return entry;
+}
+
+void jitFree(FormulaLoop loop) {
+  unsigned char *mapping;
+  size_t size;
+  void *code;
+
+  if (!loop)
+    return;
+
+  memcpy(&code, &loop, sizeof(code));
+  mapping = (unsigned char *)code - HEADER;
+  memcpy(&size, mapping, sizeof(size));
+  munmap(mapping, size);
+}
+
+#else
+
+FormulaLoop jitCompile(const FormulaOp *ops, unsigned int count) {
+  (void)ops;
+  (void)count;
+  return NULL;
+}
+
+void jitFree(FormulaLoop loop) { (void)loop; }
+
+#endif
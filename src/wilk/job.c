@@ -0,0 +1,138 @@
+#include <wilk/formula.h>
+#include <wilk/job.h>
+#include <wilk/kernel.h>
+#include <wilk/limit.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The value of a key=value word, NULL if word has another key. */
+static const char *valueOf(const char *word, const char *key) {
+  size_t length = strlen(key);
+
+  if (strncmp(word, key, length) != 0 || word[length] != '=')
+    return NULL;
+
+  return word + length + 1;
+}
+
+static char parseWord(const char *word, Job *job) {
+  const char *value;
+
+  if (strcmp(word, "distance") == 0) {
+    job->view.kernel = KERNEL_DISTANCE;
+    return 1;
+  }
+
+  if (strcmp(word, "equalize") == 0) {
+    job->equalize = 1;
+    return 1;
+  }
+
+  if ((value = valueOf(word, "formula")))
+    return formulaParse(value, &job->view.formula);
+
+  if ((value = valueOf(word, "julia"))) {
+    job->view.julia = 1;
+    return sscanf(value, "%lf,%lf", &job->view.cx, &job->view.cy) == 2;
+  }
+
+  if ((value = valueOf(word, "sweep"))) {
+    if (!job->frames)
+      job->frames = 2;
+    return sscanf(value, "%lf,%lf", &job->sweepX, &job->sweepY) == 2;
+  }
+
+  if ((value = valueOf(word, "frames"))) {
+    job->frames = strtoul(value, NULL, 10);
+    return job->frames > 0;
+  }
+
+  if ((value = valueOf(word, "center")))
+    return sscanf(value, "%lf,%lf", &job->view.x, &job->view.y) == 2;
+
+  if ((value = valueOf(word, "scale"))) {
+    job->view.scale = atof(value);
+    return job->view.scale > 0.0;
+  }
+
+  if ((value = valueOf(word, "iterations"))) {
+    job->autoIterations = strcmp(value, "auto") == 0;
+    if (job->autoIterations)
+      return 1;
+    job->view.maxIterations = atof(value);
+    return job->view.maxIterations >= 1.0;
+  }
+
+  if ((value = valueOf(word, "size")))
+    return sscanf(value, "%ux%u", &job->width, &job->height) == 2 &&
+           job->width && job->height;
+
+  if ((value = valueOf(word, "output"))) {
+    if (!*value || strlen(value) >= sizeof(job->output))
+      return 0;
+    strcpy(job->output, value);
+    return 1;
+  }
+
+  return 0;
+}
+
+int jobParse(char *line, Job *job) {
+  char *comment = strchr(line, '#');
+  char *word, *save;
+  int words = 0;
+
+  if (comment)
+    *comment = '\0';
+
+  /* Without a sweep= word c stays where it is. */
+  job->sweepX = NAN;
+
+  for (word = strtok_r(line, " \t\r\n", &save); word;
+       word = strtok_r(NULL, " \t\r\n", &save), words++) {
+    if (!parseWord(word, job)) {
+      fprintf(stderr, "[Error] Bad job word '%s'\n", word);
+      return -1;
+    }
+  }
+
+  if (job->autoIterations)
+    job->view.maxIterations = limitFor(NULL, job->view.scale);
+
+  if (isnan(job->sweepX)) {
+    job->sweepX = job->view.cx;
+    job->sweepY = job->view.cy;
+  }
+
+  if (job->view.kernel == KERNEL_DISTANCE &&
+      FORMULA_INDEX(job->view.formula) == FORMULA_CUSTOM) {
+    fprintf(stderr, "[Error] Custom formulas have no distance estimate\n");
+    return -1;
+  }
+
+  if (job->frames && !job->view.julia) {
+    fprintf(stderr, "[Error] A sweep needs a julia=X,Y start\n");
+    return -1;
+  }
+
+  return words ? 1 : 0;
+}
+
+char jobFrame(const Job *job, uint32_t frame, Job *out) {
+  double t = job->frames > 1 ? (double)frame / (job->frames - 1) : 0.0;
+  const char *dot = strrchr(job->output, '.');
+  int length = dot && !strchr(dot, '/') ? (int)(dot - job->output)
+                                        : (int)strlen(job->output);
+
+  *out = *job;
+  out->frames = 0;
+  out->view.cx += (job->sweepX - job->view.cx) * t;
+  out->view.cy += (job->sweepY - job->view.cy) * t;
+
+  return snprintf(out->output, sizeof(out->output), "%.*s-%04u%s", length,
+                  job->output, frame, job->output + length) <
+         (int)sizeof(out->output);
+}
@@ -0,0 +1,407 @@
+#include <wilk/curve.h>
+#include <wilk/formula.h>
+#include <wilk/kernel.h>
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Large bailout so the distance estimate has converged when we stop. */
+#define DISTANCE_BAILOUT (256.0 * 256.0)
+/* Side of the blocks the distance kernel tries to fill at once. */
+#define DISTANCE_BLOCK 8
+#define MAX_THREADS 64
+
+/* Pixels [x0, x1) x [y0, y1) of a tile. Pixel (i, j) goes to out at
+ * (j - oy) * stride + i - ox, so a region is written either into the whole
+ * tile or into a block of its own. */
+typedef struct {
+  uint32_t x0, x1, y0, y1;
+  uint32_t ox, oy, stride;
+  void *out;
+} Region;
+
+/* The blocks of a tile, handed out to threads in the given order. */
+typedef struct {
+  const TileKey *key;
+  void *out;
+  const uint32_t *order;
+  uint32_t columns, count, next;
+  char blocked;
+} Blocks;
+
+/* Inlined into every kernel with a constant formula, which leaves a single
+ * branch free body per formula. */
+#define SPECIALISED static inline __attribute__((always_inline))
+
+/* z <- f(z) + c. */
+SPECIALISED void step(uint32_t formula, double *zx, double *zy, double cx,
+                      double cy) {
+  double x = *zx, y = *zy, a, b;
+
+  switch (formula) {
+  case FORMULA_BURNING_SHIP:
+    *zx = x * x - y * y + cx;
+    *zy = 2.0 * fabs(x * y) + cy;
+    break;
+  case FORMULA_TRICORN:
+    *zx = x * x - y * y + cx;
+    *zy = -2.0 * x * y + cy;
+    break;
+  case FORMULA_CUBIC:
+    *zx = x * (x * x - 3.0 * y * y) + cx;
+    *zy = y * (3.0 * x * x - y * y) + cy;
+    break;
+  case FORMULA_QUARTIC:
+    a = x * x - y * y;
+    b = 2.0 * x * y;
+    *zx = a * a - b * b + cx;
+    *zy = 2.0 * a * b + cy;
+    break;
+  default:
+    *zx = x * x - y * y + cx;
+    *zy = 2.0 * x * y + cy;
+  }
+}
+
+/* dz <- f'(z) dz + dc, before z itself steps. The folds of the burning ship
+ * and the conjugate of the tricorn keep |dz| right, which is all the
+ * distance estimate needs. */
+SPECIALISED void stepDerivative(uint32_t formula, double zx, double zy,
+                                double *dzx, double *dzy, double dc) {
+  double x = *dzx, y = *dzy, a, b;
+
+  switch (formula) {
+  case FORMULA_BURNING_SHIP:
+    *dzx = 2.0 * (zx * x - zy * y) + dc;
+    *dzy = copysign(2.0, zx * zy) * (zx * y + zy * x);
+    break;
+  case FORMULA_TRICORN:
+    *dzx = 2.0 * (zx * x - zy * y) + dc;
+    *dzy = -2.0 * (zx * y + zy * x);
+    break;
+  case FORMULA_CUBIC:
+    a = 3.0 * (zx * zx - zy * zy);
+    b = 6.0 * zx * zy;
+    *dzx = a * x - b * y + dc;
+    *dzy = a * y + b * x;
+    break;
+  case FORMULA_QUARTIC:
+    a = 4.0 * zx * (zx * zx - 3.0 * zy * zy);
+    b = 4.0 * zy * (3.0 * zx * zx - zy * zy);
+    *dzx = a * x - b * y + dc;
+    *dzy = a * y + b * x;
+    break;
+  default:
+    *dzx = 2.0 * (zx * x - zy * y) + dc;
+    *dzy = 2.0 * (zx * y + zy * x);
+  }
+}
+
+/* z starts at the pixel (px, py), c is the pixel too unless the key is of a
+ * Julia set. */
+SPECIALISED uint32_t escapeTime(const TileKey *key, uint32_t formula,
+                                double px, double py) {
+  double cx = key->julia ? key->cx : px, cy = key->julia ? key->cy : py;
+  double zx = px, zy = py, maxIterations = key->maxIterations;
+  uint32_t it = 0;
+
+  while (zx * zx + zy * zy <= 4.0 && it < maxIterations) {
+    step(formula, &zx, &zy, cx, cy);
+    it++;
+  }
+
+  return it;
+}
+
+/* Lower bound for the distance from the pixel to the set, iterating dz/dc
+ * (or dz/dz0 for a Julia set) next to z. Returns 0 for points that did not
+ * escape. */
+SPECIALISED double distanceEstimate(const TileKey *key, uint32_t formula,
+                                    double px, double py) {
+  double cx = key->julia ? key->cx : px, cy = key->julia ? key->cy : py;
+  double zx = px, zy = py, dzx = 1.0, dzy = 0.0, r2, r;
+  double dc = key->julia ? 0.0 : 1.0, maxIterations = key->maxIterations;
+  uint32_t it = 0;
+
+  while ((r2 = zx * zx + zy * zy) <= DISTANCE_BAILOUT && it < maxIterations) {
+    stepDerivative(formula, zx, zy, &dzx, &dzy, dc);
+    step(formula, &zx, &zy, cx, cy);
+    it++;
+  }
+
+  if (r2 <= DISTANCE_BAILOUT)
+    return 0.0;
+
+  r = sqrt(r2);
+  return 0.5 * r * log(r) / hypot(dzx, dzy);
+}
+
+static void store(const TileKey *key, const Region *region, uint32_t i,
+                  uint32_t j, double value) {
+  size_t idx = (size_t)(j - region->oy) * region->stride + i - region->ox;
+
+  if (key->format == TILE_FORMAT_F32)
+    ((float *)region->out)[idx] = (float)value;
+  else
+    ((uint32_t *)region->out)[idx] = (uint32_t)value;
+}
+
+SPECIALISED void renderEscapeTime(const TileKey *key, uint32_t formula,
+                                  const Region *region) {
+  for (uint32_t j = region->y0; j < region->y1; j++) {
+    double py = key->y + j * key->dy;
+
+    for (uint32_t i = region->x0; i < region->x1; i++)
+      store(key, region, i, j,
+            escapeTime(key, formula, key->x + i * key->dx, py));
+  }
+}
+
+/* No point of the set lies within the estimated distance of c, so when a
+ * block fits in that disk with DISTANCE_FAR pixels to spare every pixel in
+ * it is far from the boundary and one sample colours the whole block. */
+SPECIALISED void renderDistance(const TileKey *key, uint32_t formula,
+                                const Region *region) {
+  uint32_t end = region->y1, right = region->x1;
+
+  for (uint32_t by = region->y0; by < end; by += DISTANCE_BLOCK) {
+    uint32_t bh = end - by < DISTANCE_BLOCK ? end - by : DISTANCE_BLOCK;
+
+    for (uint32_t bx = region->x0; bx < right; bx += DISTANCE_BLOCK) {
+      uint32_t bw = right - bx < DISTANCE_BLOCK ? right - bx : DISTANCE_BLOCK;
+      double hx = (bw - 1) * key->dx / 2.0, hy = (bh - 1) * key->dy / 2.0;
+      double d = distanceEstimate(key, formula, key->x + bx * key->dx + hx,
+                                  key->y + by * key->dy + hy);
+      double margin = (d - hypot(hx, hy)) / key->dx;
+
+      for (uint32_t j = by; j < by + bh; j++)
+        for (uint32_t i = bx; i < bx + bw; i++) {
+          double value = margin;
+
+          if (margin < DISTANCE_FAR)
+            value = distanceEstimate(key, formula, key->x + i * key->dx,
+                                     key->y + j * key->dy) /
+                    key->dx;
+
+          store(key, region, i, j, value);
+        }
+    }
+  }
+}
+
+/* Custom formulas run the loop from formula.c, there is no derivative for
+ * a distance estimate. */
+static void renderCustom(const TileKey *key, const Region *region) {
+  FormulaLoop loop = formulaLoop(key->formula);
+  uint32_t limit = (uint32_t)ceil(key->maxIterations);
+
+  /* Not the formula loaded in this process, callers ask kernelSupports()
+   * first. Zeros at least never pass for the data of another tile. */
+  if (!loop) {
+    for (uint32_t j = region->y0; j < region->y1; j++)
+      for (uint32_t i = region->x0; i < region->x1; i++)
+        store(key, region, i, j, 0.0);
+    return;
+  }
+
+  for (uint32_t j = region->y0; j < region->y1; j++) {
+    double py = key->y + j * key->dy;
+
+    for (uint32_t i = region->x0; i < region->x1; i++) {
+      double px = key->x + i * key->dx;
+
+      store(key, region, i, j,
+            key->julia ? loop(px, py, key->cx, key->cy, limit)
+                       : loop(px, py, px, py, limit));
+    }
+  }
+}
+
+/* The kernels of one formula. */
+#define SPECIALISE(formula, name)                                              \
+  static void render##name(const TileKey *key, const Region *region) {       \
+    if (key->kernel == KERNEL_DISTANCE)                                        \
+      renderDistance(key, formula, region);                                    \
+    else                                                                       \
+      renderEscapeTime(key, formula, region);                                  \
+  }
+
+SPECIALISE(FORMULA_MANDELBROT, Mandelbrot)
+SPECIALISE(FORMULA_BURNING_SHIP, BurningShip)
+SPECIALISE(FORMULA_TRICORN, Tricorn)
+SPECIALISE(FORMULA_CUBIC, Cubic)
+SPECIALISE(FORMULA_QUARTIC, Quartic)
+
+static void (*const renderers[FORMULA_COUNT])(const TileKey *,
+                                              const Region *) = {
+    [FORMULA_MANDELBROT] = renderMandelbrot,
+    [FORMULA_BURNING_SHIP] = renderBurningShip,
+    [FORMULA_TRICORN] = renderTricorn,
+    [FORMULA_CUBIC] = renderCubic,
+    [FORMULA_QUARTIC] = renderQuartic,
+    [FORMULA_CUSTOM] = renderCustom,
+};
+
+char kernelSupports(const TileKey *key) {
+  return FORMULA_INDEX(key->formula) != FORMULA_CUSTOM ||
+         formulaLoop(key->formula) != NULL;
+}
+
+static void renderRegion(const TileKey *key, const Region *region) {
+  if (region->x0 < region->x1 && region->y0 < region->y1 &&
+      FORMULA_INDEX(key->formula) < FORMULA_COUNT)
+    renderers[FORMULA_INDEX(key->formula)](key, region);
+}
+
+void kernelRender(const TileKey *key, uint32_t row, uint32_t rows, void *out) {
+  uint32_t end = row + rows < key->height ? row + rows : key->height;
+  Region region = {0, key->width, row, end, 0, 0, key->width, out};
+
+  renderRegion(key, &region);
+}
+
+void kernelRenderRect(const TileKey *key, uint32_t x, uint32_t y,
+                      uint32_t width, uint32_t height, void *out) {
+  Region region = {x, x + width < key->width ? x + width : key->width,
+                   y, y + height < key->height ? y + height : key->height,
+                   0, 0, key->width, out};
+
+  renderRegion(key, &region);
+}
+
+uint32_t kernelBlockCount(const TileKey *key, uint32_t *columns) {
+  uint32_t across = (key->width + KERNEL_BLOCK - 1) / KERNEL_BLOCK;
+
+  if (columns)
+    *columns = across;
+  return across * ((key->height + KERNEL_BLOCK - 1) / KERNEL_BLOCK);
+}
+
+/* Pixels of the block in the given row-major block grid. */
+static Region blockRegion(const TileKey *key, uint32_t block, uint32_t columns,
+                          void *out) {
+  uint32_t x = block % columns * KERNEL_BLOCK;
+  uint32_t y = block / columns * KERNEL_BLOCK;
+  Region region = {x, x + KERNEL_BLOCK < key->width ? x + KERNEL_BLOCK
+                                                    : key->width,
+                   y, y + KERNEL_BLOCK < key->height ? y + KERNEL_BLOCK
+                                                     : key->height,
+                   0, 0, key->width, out};
+
+  return region;
+}
+
+void kernelRenderBlock(const TileKey *key, uint32_t block, void *out) {
+  uint32_t columns;
+  Region region;
+
+  kernelBlockCount(key, &columns);
+  region = blockRegion(key, block, columns, out);
+  region.ox = region.x0;
+  region.oy = region.y0;
+  region.stride = KERNEL_BLOCK;
+  renderRegion(key, &region);
+}
+
+/* Renders the block at the given position of the order. Values are 4 bytes
+ * in either format. */
+static void renderBlock(const Blocks *blocks, uint32_t position) {
+  uint32_t block = blocks->order[position];
+  Region region;
+
+  if (blocks->blocked) {
+    kernelRenderBlock(blocks->key, block,
+                      (uint32_t *)blocks->out +
+                          (size_t)position * KERNEL_BLOCK * KERNEL_BLOCK);
+    return;
+  }
+
+  region = blockRegion(blocks->key, block, blocks->columns, blocks->out);
+  renderRegion(blocks->key, &region);
+}
+
+static void *renderBlocks(void *arg) {
+  Blocks *blocks = arg;
+  uint32_t position;
+
+  while ((position = __atomic_fetch_add(&blocks->next, 1, __ATOMIC_RELAXED)) <
+         blocks->count)
+    renderBlock(blocks, position);
+
+  return NULL;
+}
+
+char kernelRenderBlocks(const TileKey *key, void *out, unsigned int threads,
+                        uint32_t curve, char blocked) {
+  pthread_t pool[MAX_THREADS];
+  Blocks blocks = {key, out, NULL, 0, 0, 0, blocked};
+  unsigned int started = 0;
+  uint32_t *order;
+
+  if (!kernelSupports(key))
+    return 0;
+
+  blocks.count = kernelBlockCount(key, &blocks.columns);
+  order = malloc(blocks.count * sizeof(*order));
+  if (!order)
+    return 0;
+
+  curveOrder(curve, blocks.columns, blocks.count / blocks.columns, order);
+  blocks.order = order;
+
+  if (threads > MAX_THREADS)
+    threads = MAX_THREADS;
+
+  /* The calling thread works too. */
+  while (started + 1 < threads &&
+         pthread_create(&pool[started], NULL, renderBlocks, &blocks) == 0)
+    started++;
+
+  renderBlocks(&blocks);
+
+  for (unsigned int i = 0; i < started; i++)
+    pthread_join(pool[i], NULL);
+
+  free(order);
+  return 1;
+}
+
+char kernelRenderParallel(const TileKey *key, void *out, unsigned int threads) {
+  if (!kernelSupports(key))
+    return 0;
+
+  /* Without memory for the order it still gets done, on this thread. */
+  if (!kernelRenderBlocks(key, out, threads, CURVE_HILBERT, 0))
+    kernelRender(key, 0, key->height, out);
+  return 1;
+}
+
+char kernelUnblock(const TileKey *key, uint32_t curve, const void *blocked,
+                   void *out) {
+  uint32_t columns, count = kernelBlockCount(key, &columns);
+  uint32_t *order = malloc(count * sizeof(*order));
+
+  if (!order)
+    return 0;
+
+  curveOrder(curve, columns, count / columns, order);
+  for (uint32_t position = 0; position < count; position++) {
+    uint32_t x = order[position] % columns * KERNEL_BLOCK;
+    uint32_t y = order[position] / columns * KERNEL_BLOCK;
+    uint32_t width = key->width - x < KERNEL_BLOCK ? key->width - x
+                                                   : KERNEL_BLOCK;
+    uint32_t height = key->height - y < KERNEL_BLOCK ? key->height - y
+                                                     : KERNEL_BLOCK;
+    const uint32_t *block = (const uint32_t *)blocked +
+                            (size_t)position * KERNEL_BLOCK * KERNEL_BLOCK;
+
+    for (uint32_t j = 0; j < height; j++)
+      memcpy((uint32_t *)out + (size_t)(y + j) * key->width + x,
+             block + (size_t)j * KERNEL_BLOCK, width * sizeof(uint32_t));
+  }
+
+  free(order);
+  return 1;
+}
@@ -0,0 +1,62 @@
+#include <wilk/histogram.h>
+#include <wilk/limit.h>
+
+#include <math.h>
+
+#define MIN_LIMIT 32.0
+#define MAX_LIMIT 1048576.0
+/* Escapes in the top eighth of the range mean the cap cuts off detail. */
+#define NEAR_CAP_BIN (HISTOGRAM_BINS * 7 / 8)
+#define NEAR_CAP_SHARE 0.001
+/* Most of the frame at the cap says nothing about how far it is below it,
+ * assume it is too low. */
+#define CAPPED_SHARE 0.5
+
+/* 100 iterations for the whole set, 50 more per doubling of the zoom. */
+static double depthLimit(double scale) {
+  return 100.0 + 50.0 * fmax(0.0, log2(scale));
+}
+
+double limitFor(const IterationLimit *limit, double scale) {
+  double bias = limit ? limit->bias : 0.0;
+
+  /* Whole iterations, so tile keys stay stable between frames. */
+  return round(fmin(fmax(depthLimit(scale) * exp2(bias), MIN_LIMIT),
+                    MAX_LIMIT));
+}
+
+char limitFeedback(IterationLimit *limit, const uint32_t *bins,
+                   double maxIterations, double scale) {
+  uint64_t total = 0, nearCap = 0, capped = bins[HISTOGRAM_BINS - 1];
+  double target, highest;
+  int last = -1;
+
+  /* The last bin holds the pixels that hit the cap. */
+  for (int i = 0; i < HISTOGRAM_BINS; i++) {
+    total += bins[i];
+    if (i >= NEAR_CAP_BIN && i < HISTOGRAM_BINS - 1)
+      nearCap += bins[i];
+    if (i < HISTOGRAM_BINS - 1 && bins[i])
+      last = i;
+  }
+
+  if (!total)
+    return 0;
+
+  highest = (last + 1) * maxIterations / (HISTOGRAM_BINS - 1);
+
+  if (capped && (nearCap > total * NEAR_CAP_SHARE ||
+                 capped > total * CAPPED_SHARE))
+    target = maxIterations * M_SQRT2;
+  else if (last >= 0 && highest < maxIterations / 4)
+    target = highest * 2;
+  else
+    return 0;
+
+  target = fmin(fmax(target, MIN_LIMIT), MAX_LIMIT);
+  if (round(target) == round(maxIterations))
+    return 0;
+
+  limit->bias = log2(target / depthLimit(scale));
+  return 1;
+}
@@ -1,8 +1,29 @@
+#include <getopt.h>
 #include <glad/gl.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
+#include <wilk/arena.h>
+#include <wilk/budget.h>
+#include <wilk/farm.h>
+#include <wilk/formula.h>
+#include <wilk/framering.h>
+#include <wilk/image.h>
+#include <wilk/job.h>
+#include <wilk/kernel.h>
+#include <wilk/limit.h>
+#include <wilk/overview.h>
+#include <wilk/prefetch.h>
+#include <wilk/readback.h>
+#include <wilk/reload.h>
+#include <wilk/renderer.h>
+#include <wilk/tilestore.h>
+#include <wilk/view.h>
+#include <wilk/zoom.h>
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
@@ -10,88 +31,107 @@ void glfwError(int id, const char *description) {
   fprintf(stderr, "Error: %d (%s)\n", id, description);
 }
 
-const char *readFile(const char *path) {
-  unsigned int size;
-  char *buffer;
-  FILE *fp;
+void setFramebufferSize(GLFWwindow *window, int width, int height) {
+  (void)window;
+  glViewport(0, 0, width, height);
+}
 
-  fp = fopen(path, "r");
-  if (!fp)
-    return NULL;
+View view = {0.0, 0.0, 1.0, 100.0, KERNEL_ESCAPE_TIME,
+             FORMULA_MANDELBROT, 0, 0.0, 0.0};
+Prefetcher *prefetcher = NULL;
+uint64_t storeCapacity = TILE_STORE_CAPACITY;
+char equalize = 0;
 
-  fseek(fp, 0L, SEEK_END);
-  size = ftell(fp);
-  fseek(fp, 0L, SEEK_SET);
+/* A window of the interactive session. Every window has a view of its own
+ * and they all render in one loop, see interactive(). The first one is the
+ * main window, the only one prefetched, captured and measured for the
+ * automatic limit. */
+typedef struct {
+  GLFWwindow *window;
+  Renderer renderer; /* programs are shared with the main window */
+  View view, shown, rendered, measured;
+  View mandelbrot; /* where M returns to from a Julia set */
+  Budget budget;
+  Overview overview;
+  GLsync done; /* the render in the target is complete */
+  char hasRendered;
+} Pane;
 
-  buffer = (char *)malloc(size + 1 * sizeof(char));
-  fread(buffer, sizeof(char), size, fp);
-  buffer[size] = '\0';
+#define MAX_PANES 8
+Pane panes[MAX_PANES];
+unsigned int paneCount = 1;
 
-  fclose(fp);
-  return buffer;
-}
+/* Overview picture in the corner of every window, see overview.h. */
+char showOverview = 1;
 
-char checkLinkError(GLuint idx) {
-  char log[1024];
-  GLint ok;
+/* Iteration limit picked from the zoom depth and frame statistics. */
+IterationLimit limit = {0};
+char autoLimit = 0;
 
-  glGetProgramiv(idx, GL_LINK_STATUS, &ok);
+/* Iterations per pixel and GPU dispatch, see renderer.h. */
+unsigned int chunkIterations = RENDERER_CHUNK;
 
-  if (!ok) {
-    glGetProgramInfoLog(idx, 1024, NULL, log);
-    printf("Shader link failed with error: %s\n", log);
-    return 0;
-  }
+/* Target frame time while interactive, see budget.h. */
+double frameBudget = 0.016;
 
-  return 1;
-}
+/* Part of the window resolution rendered while moving, on top of the
+ * budget, and how it is stretched back. */
+double renderScale = 1.0;
+Upscale upscale = UPSCALE_EDGE;
 
-char checkShaderCompileError(GLuint idx) {
-  char log[1024];
-  GLint compiled;
+/* Shared memory frame output, see framering.h. */
+const char *ringName = NULL;
+unsigned int ringWidth = 3840, ringHeight = 2160;
+FrameRing *ring = NULL;
 
-  glGetShaderiv(idx, GL_COMPILE_STATUS, &compiled);
+/* Frame times and iteration statistics of the main window as CSV, see
+ * stats.h, and the cost overlay. */
+const char *profilePath = NULL;
+FILE *profile = NULL;
+char heatmap = 0;
 
-  if (!compiled) {
-    glGetShaderInfoLog(idx, 1024, NULL, log);
-    printf("Shader compile failed with error: %s\n", log);
-    glDeleteShader(idx);
-    return 0;
-  }
+/* Frame captures, all read back through readback.h. */
+enum { CAPTURE_RING = 1, CAPTURE_SCREENSHOT = 2, CAPTURE_VIDEO = 4 };
+const char *videoPath = NULL;
+FILE *video = NULL;
+char screenshot = 0;
 
-  return 1;
-}
+/* log2 of the zoom per key press and per scroll step. */
+const double keyZoom = 1.0;
+const double scrollZoom = 0.25;
 
-void setFramebufferSize(GLFWwindow *window, int width, int height) {
-  (void)window;
-  glViewport(0, 0, width, height);
+/* Follows a changed automatic limit in every window. */
+void followLimit(void) {
+  for (unsigned int i = 0; i < paneCount; i++)
+    panes[i].view.maxIterations = limitFor(&limit, panes[i].view.scale);
+  prefetchLimit(prefetcher, &limit);
 }
 
-float vertices[] = {
-    +1.0f, +1.0f, 0.0f, // top right
-    +1.0f, -1.0f, 0.0f, // bottom right
-    -1.0f, -1.0f, 0.0f, // bottom left
-    -1.0f, +1.0f, 0.0f  // top left
-};
+void move(Pane *pane, const Motion *motion) {
+  Motion m = *motion;
 
-unsigned int indices[] = {
-    // note that we start from 0!
-    0, 1, 3, // first triangle
-    1, 2, 3  // second triangle
-};
+  /* J and K nudge the automatic limit instead of replacing it. */
+  if (autoLimit) {
+    limit.bias += m.iterations * 0.25;
+    m.iterations = 0.0;
+  }
 
-double scale = 1.0f;
-double x = 0.0, y = 0.0;
-double maxInterations = 100.0;
+  viewApply(&pane->view, &m);
+  if (autoLimit)
+    followLimit();
 
-const double megaScale = 5080.0f;
-const double speed = 0.10;
+  if (pane == panes)
+    prefetchMotion(prefetcher, &m);
+}
 
 void onKeyPress(GLFWwindow *window, int key, int scancode, int action,
                 int mods) {
+  Pane *pane = glfwGetWindowUserPointer(window);
+  View *v = &pane->view;
+  Motion motion = {0};
+
   (void)scancode;
   (void)mods;
-  (void)window;
 
   if (action != GLFW_PRESS)
     return;
@@ -99,183 +139,1022 @@ void onKeyPress(GLFWwindow *window, int key, int scancode, int action,
   switch (key) {
   case GLFW_KEY_ESCAPE:
     glfwSetWindowShouldClose(window, GL_TRUE);
-    break;
+    return;
   case GLFW_KEY_UP:
-    y += speed / scale;
+    motion.panY = 1;
     break;
   case GLFW_KEY_DOWN:
-    y -= speed / scale;
+    motion.panY = -1;
     break;
   case GLFW_KEY_LEFT:
-    x -= speed / scale;
+    motion.panX = -1;
     break;
   case GLFW_KEY_RIGHT:
-    x += speed / scale;
+    motion.panX = 1;
     break;
   case GLFW_KEY_I:
-    scale += megaScale;
+    motion.zoom = keyZoom;
     break;
   case GLFW_KEY_O:
-    scale -= megaScale;
+    motion.zoom = -keyZoom;
     break;
   case GLFW_KEY_J:
-    maxInterations -= 1.0;
+    motion.iterations = -1.0;
     break;
   case GLFW_KEY_K:
-    maxInterations += 1.0;
+    motion.iterations = 1.0;
     break;
+  case GLFW_KEY_A:
+    autoLimit = !autoLimit;
+    if (autoLimit)
+      followLimit();
+    else
+      prefetchLimit(prefetcher, NULL);
+    return;
+  case GLFW_KEY_H:
+    equalize = !equalize && panes[0].renderer.histogram.cdf;
+    return;
+  case GLFW_KEY_F12:
+    screenshot = 1;
+    return;
+  case GLFW_KEY_V:
+    showOverview = !showOverview;
+    return;
+  case GLFW_KEY_C:
+    heatmap = !heatmap;
+    for (unsigned int i = 0; i < paneCount; i++)
+      panes[i].renderer.heatmap = heatmap;
+    return;
+  case GLFW_KEY_LEFT_BRACKET:
+    renderScale = fmax(renderScale / M_SQRT2, BUDGET_MIN_RESOLUTION);
+    printf("[Info] Render scale %.0f%%\n", renderScale * 100);
+    return;
+  case GLFW_KEY_RIGHT_BRACKET:
+    renderScale = fmin(renderScale * M_SQRT2, 1.0);
+    printf("[Info] Render scale %.0f%%\n", renderScale * 100);
+    return;
+  case GLFW_KEY_U:
+    upscale = upscale == UPSCALE_EDGE ? UPSCALE_BILINEAR : UPSCALE_EDGE;
+    for (unsigned int i = 0; i < paneCount; i++)
+      panes[i].renderer.upscale = upscale;
+    return;
+  case GLFW_KEY_F:
+    v->formula = formulaNext(v->formula);
+    if (FORMULA_INDEX(v->formula) == FORMULA_CUSTOM)
+      v->kernel = KERNEL_ESCAPE_TIME;
+    return;
+  case GLFW_KEY_M:
+    /* The Julia set of the point in the middle of the screen. */
+    if (v->julia) {
+      pane->mandelbrot.kernel = v->kernel;
+      *v = pane->mandelbrot;
+    } else {
+      pane->mandelbrot = *v;
+      v->cx = v->x;
+      v->cy = v->y;
+      v->x = v->y = 0.0;
+      v->scale = 1.0;
+      v->julia = 1;
+    }
+    if (autoLimit)
+      v->maxIterations = limitFor(&limit, v->scale);
+    return;
+  case GLFW_KEY_D:
+    /* Custom formulas have no derivative. */
+    if (FORMULA_INDEX(v->formula) == FORMULA_CUSTOM)
+      return;
+    v->kernel = v->kernel == KERNEL_DISTANCE ? KERNEL_ESCAPE_TIME
+                                             : KERNEL_DISTANCE;
+    return;
+  default:
+    return;
   }
+
+  move(pane, &motion);
 }
 
 void onScroll(GLFWwindow *window, double xoffset, double yoffset) {
-  (void)window;
+  Motion motion = {0};
+  double cursorX, cursorY;
+  int width, height;
+
   (void)xoffset;
-  scale += yoffset;
+
+  glfwGetCursorPos(window, &cursorX, &cursorY);
+  glfwGetWindowSize(window, &width, &height);
+  if (!width || !height)
+    return;
+
+  /* Zoom toward the cursor, window coordinates start at the top left. */
+  motion.zoom = yoffset * scrollZoom;
+  motion.pivotX = cursorX / width * 2.0 - 1.0;
+  motion.pivotY = 1.0 - cursorY / height * 2.0;
+  move(glfwGetWindowUserPointer(window), &motion);
+}
+
+void onReadback(const void *pixels, uint32_t width, uint32_t height,
+                const View *v, unsigned int targets) {
+  if (targets & CAPTURE_RING) {
+    unsigned char *frame = frameRingBegin(ring, width, height);
+
+    if (frame) {
+      memcpy(frame, pixels, (size_t)width * height * 4);
+      frameRingPublish(ring, v);
+    }
+  }
+
+  if (targets & CAPTURE_SCREENSHOT) {
+    char path[64];
+
+    snprintf(path, sizeof(path), "wilk-%ld.ppm", (long)time(NULL));
+    if (imageWriteRGBA(path, width, height, pixels))
+      printf("[Info] Saved %s\n", path);
+    else
+      fprintf(stderr, "[Error] Unable to save %s\n", path);
+  }
+
+  if ((targets & CAPTURE_VIDEO) &&
+      !imageWriteFrame(video, width, height, pixels)) {
+    fprintf(stderr, "[Error] Unable to write to %s, stopped recording\n",
+            videoPath);
+    fclose(video);
+    video = NULL;
+  }
 }
 
-int main(void) {
+/* Tiles are shared with every other wilk on this machine. */
+TileStore *openTileStore(void) {
+  char path[4096];
+  const char *base = getenv("XDG_CACHE_HOME");
+
+  if (base && *base) {
+    snprintf(path, sizeof(path), "%s/wilk", base);
+  } else {
+    base = getenv("HOME");
+    if (!base)
+      return NULL;
+
+    snprintf(path, sizeof(path), "%s/.cache", base);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/.cache/wilk", base);
+  }
+
+  return tileStoreOpen(path, storeCapacity);
+}
+
+/* The detail the budget and render scale allow for the shown view. */
+void budgetDetail(const Renderer *renderer, const Budget *budget,
+                  const View *shown, char settled, Detail *detail) {
+  double resolution = budget->resolution * (settled ? 1.0 : renderScale);
+
+  rendererFullDetail(renderer, shown, detail);
+  detail->width = ceil(detail->width * resolution);
+  detail->height = ceil(detail->height * resolution);
+  detail->maxIterations = ceil(shown->maxIterations * budget->iterations);
+}
+
+char fullDetail(const Renderer *renderer, const Detail *detail,
+                const View *shown) {
+  return detail->width == renderer->width &&
+         detail->height == renderer->height &&
+         detail->maxIterations >= shown->maxIterations;
+}
+
+/* Creates a window, its context and renderer, hidden ones render batch
+ * jobs. With share the context shares objects with that window and the
+ * renderer its programs with shared. */
+GLFWwindow *createWindow(char visible, GLFWwindow *share, Renderer *renderer,
+                         Renderer *shared) {
   GLFWwindow *window;
-  GLuint vbo, ebo, vao, vertexShader, fragmentShader, program, width, height,
-      fps = 0, avg = 0;
-  const char *vertexShaderSource, *fragmentShaderSource;
-  char title[256] = {0};
-  time_t tick;
 
   if (!glfwInit()) {
     const char *description;
     glfwGetError(&description);
     fprintf(stderr, "Unable to initialize GLFW: %s\n", description);
-    return 1;
+    return NULL;
   }
 
+  /* 4.3 brings compute shaders for histogram colouring, 4.0 still works
+   * with linear colouring. */
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+
+  window = glfwCreateWindow(800, 600, "Wilk", NULL, share);
   glfwSetErrorCallback(glfwError);
 
-  window = glfwCreateWindow(800, 600, "Wilk", NULL, NULL);
-  tick = time(NULL);
+  if (!window) {
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+    window = glfwCreateWindow(800, 600, "Wilk", NULL, share);
+  }
 
   if (!window) {
     fputs("Unable to create window!", stderr);
-    glfwTerminate();
-    return 1;
+    if (!share)
+      glfwTerminate();
+    return NULL;
   }
 
   glfwMakeContextCurrent(window);
   gladLoadGL(glfwGetProcAddress);
-  glfwSetFramebufferSizeCallback(window, setFramebufferSize);
 
-  puts("[Info] Initializing");
-  vertexShader = glCreateShader(GL_VERTEX_SHADER);
-  fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-  program = glCreateProgram();
-  fragmentShaderSource = readFile("src/shader/wilk.frag");
-  vertexShaderSource = readFile("src/shader/wilk.vert");
+  if (!share)
+    puts("[Info] Initializing");
+  if (!rendererInit(renderer, shared)) {
+    if (share)
+      glfwDestroyWindow(window);
+    else
+      glfwTerminate();
+    return NULL;
+  }
+  renderer->chunkIterations = chunkIterations;
+  renderer->upscale = upscale;
+
+  if (!share)
+    printf("[Info] Renderer: %s (%s)\n", glGetString(GL_RENDERER),
+           glGetString(GL_VENDOR));
+  return window;
+}
+
+/* The render to colour a window with: its own while it still covers the
+ * shown view, otherwise the sharpest finished one of another window that
+ * does, so a window that just opened or jumped away from its last render
+ * is not blank or stretched while its own render runs. */
+Pane *source(Pane *pane) {
+  Pane *best = NULL;
+
+  if (pane->hasRendered && zoomCovers(&pane->rendered, &pane->shown))
+    return pane;
 
-  puts(" [Debug] Creating buffers");
-  glGenBuffers(1, &vbo);
-  glGenBuffers(1, &ebo);
-  glGenVertexArrays(1, &vao);
-  glBindVertexArray(vao);
+  for (unsigned int i = 0; i < paneCount; i++) {
+    Pane *other = &panes[i];
 
-  /* VBO */
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    if (other != pane && other->hasRendered && other->done &&
+        zoomCovers(&other->rendered, &pane->shown) &&
+        (!best || other->rendered.scale > best->rendered.scale))
+      best = other;
+  }
+
+  return best ? best : pane;
+}
+
+void setTitle(Pane *pane, unsigned int fps) {
+  const View *v = &pane->view;
+  char title[256];
+  int length;
+
+  length = sprintf(
+      title, "Wilk (%u FPS, [%.2f, %.2f] xy, %.2f%% scale, %.2f mit%s)", fps,
+      v->x, v->y, v->scale * 100, v->maxIterations, autoLimit ? " auto" : "");
+  if (v->formula != FORMULA_MANDELBROT)
+    length += sprintf(title + length, " %s", formulaName(v->formula));
+  if (v->julia)
+    sprintf(title + length, " Julia [%.4f, %.4f]", v->cx, v->cy);
+  glfwSetWindowTitle(pane->window, title);
+}
+
+/* Renders and colours one frame of a window into its back buffer, with its
+ * context current. dt is the time the last frame of every window took.
+ * The main window passes its readback for captures. */
+void paneFrame(Pane *pane, TileStore *store, Readback *readback, double dt) {
+  Renderer *renderer = &pane->renderer;
+  View *shown = &pane->shown, *rendered = &pane->rendered;
+  GLuint width, height;
+  Detail detail;
+  Pane *from;
+  unsigned int capture;
+  char settled, fresh;
+
+  glfwGetFramebufferSize(pane->window, (int *)&width, (int *)&height);
+
+  /* A new overview picture is rendered in the target, which has to be
+   * rendered again after it. */
+  if (showOverview &&
+      overviewUpdate(&pane->overview, renderer, store, &pane->view)) {
+    pane->hasRendered = 0;
+    renderer->busy = 0;
+  }
+
+  if (rendererResize(renderer, width, height))
+    pane->hasRendered = 0;
+
+  settled = zoomStep(shown, &pane->view, dt);
+  budgetUpdate(&pane->budget, dt, !settled);
+  budgetDetail(renderer, &pane->budget, shown, settled, &detail);
+
+  if (pane == panes)
+    prefetchObserve(prefetcher, &pane->view, width, height);
 
-  /* Sets location of the vertex to 0 */
-  //                    POS LEN TYPE    NORMALIZE STRIDE            POINTER:
-  //                                                                Position
-  //                                                                 data
-  //                                                                begins
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_TRUE, 3 * sizeof(float), (void *)0);
-  glEnableVertexAttribArray(0);
+  /* In between full renders the last one is rescaled to the shown view,
+   * the final frame of an animation is always rendered exactly and with
+   * full detail. */
+  fresh = 0;
+  if (!pane->hasRendered || zoomError(rendered, shown) >= 1.0 ||
+      (settled && (!viewEquals(rendered, shown) ||
+                   !fullDetail(renderer, &renderer->detail, shown)))) {
+    if (!settled && zoomError(&pane->view, shown) < 1.0 &&
+        rendererUpload(renderer, store, &pane->view)) {
+      *rendered = pane->view;
+      fresh = 1;
+    } else if (rendererUpload(renderer, store, shown)) {
+      *rendered = *shown;
+      fresh = 1;
+    } else if (!renderer->busy ||
+               (settled
+                    ? !viewEquals(&renderer->pending, shown) ||
+                          !fullDetail(renderer, &renderer->pendingDetail, shown)
+                    : zoomError(&renderer->pending, shown) >= 1.0)) {
+      /* A render still close enough to the shown view is finished. */
+      rendererBegin(renderer, shown, &detail);
+    }
+  }
 
-  /* EBO */
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
-               GL_STATIC_DRAW);
+  /* Long renders are spread over frames, as many chunks as fit. */
+  for (unsigned int i = 0; i < pane->budget.chunks && renderer->busy; i++) {
+    if (rendererContinue(renderer)) {
+      *rendered = renderer->pending;
+      fresh = 1;
+    }
+  }
 
-  puts("[Info] Compiling shaders");
-  glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-  glCompileShader(vertexShader);
+  if (fresh) {
+    rendererEqualize(renderer, rendered);
 
-  if (!checkShaderCompileError(vertexShader))
-    goto error;
+    /* Statistics of a capped render would only ask for more. */
+    if (pane == panes && autoLimit && rendered->kernel == KERNEL_ESCAPE_TIME &&
+        renderer->detail.maxIterations >= rendered->maxIterations &&
+        histogramRequest(&renderer->histogram))
+      pane->measured = *rendered;
 
-  puts(" [Debug] Compiled vertex shader");
+    if (pane == panes && profile)
+      rendererMeasure(renderer, rendered);
 
-  glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-  glCompileShader(fragmentShader);
+    /* Other contexts wait for this before they sample the target. */
+    if (pane->done)
+      glDeleteSync(pane->done);
+    pane->done = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    pane->hasRendered = 1;
+  }
 
-  if (!checkShaderCompileError(fragmentShader))
-    goto error;
+  from = source(pane);
+  if (from != pane)
+    glWaitSync(from->done, 0, GL_TIMEOUT_IGNORED);
 
-  puts(" [Debug] Compiled fragment shader");
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  rendererColourFrom(renderer, &from->renderer, &from->rendered, shown, width,
+                     height, equalize);
 
-  puts("[Info] Attaching shaders");
-  glAttachShader(program, vertexShader);
-  glAttachShader(program, fragmentShader);
-  glLinkProgram(program);
+  /* Video keeps every frame and may wait for the GPU, the ring only
+   * ever wants the newest one. Captures leave the overview out. */
+  if (readback) {
+    capture = (ring ? CAPTURE_RING : 0) |
+              (screenshot ? CAPTURE_SCREENSHOT : 0) |
+              (video ? CAPTURE_VIDEO : 0);
 
-  if (!checkLinkError(program))
-    goto error;
+    if (capture && readbackStart(readback, width, height, shown, capture,
+                                 (capture & ~CAPTURE_RING) != 0))
+      screenshot = 0;
 
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
-  free((void *)vertexShaderSource);
-  free((void *)fragmentShaderSource);
+    readbackPoll(readback, 0);
+  }
 
-  printf("[Info] Renderer: %s (%s)\n", glGetString(GL_RENDERER),
-         glGetString(GL_VENDOR));
+  if (showOverview)
+    overviewDraw(&pane->overview, shown, width, height);
+}
 
-  glfwSwapInterval(0);
-  glfwSetScrollCallback(window, onScroll);
-  glfwSetKeyCallback(window, onKeyPress);
+int interactive(void) {
+  Pane *primary = panes;
+  GLFWwindow *compiler;
+  Reloader *reloader;
+  GLuint fps = 0, avg = 0;
+  TileStore *store;
+  Readback readback;
+  uint32_t bins[HISTOGRAM_BINS];
+  Arena *arena = arenaThread();
+  IterationStats stats = {0};
+  unsigned long frames = 0;
+  char quit = 0, counted;
+  double startTime, lastTime, frameTime;
+  time_t tick;
+  long cpus;
+
+  /* Extra windows keep the position and zoom they were given, everything
+   * else follows the command line. */
+  for (unsigned int i = 0; i < paneCount; i++) {
+    Pane *pane = &panes[i];
+    View v = view;
+
+    if (i) {
+      v.x = pane->view.x;
+      v.y = pane->view.y;
+      v.scale = pane->view.scale;
+      if (autoLimit)
+        v.maxIterations = limitFor(&limit, v.scale);
+    }
 
-  while (!glfwWindowShouldClose(window)) {
+    pane->window = createWindow(1, i ? primary->window : NULL, &pane->renderer,
+                                i ? &primary->renderer : NULL);
+    if (!pane->window) {
+      if (!i)
+        return 1;
+      fprintf(stderr, "[Error] Unable to open window %u\n", i + 1);
+      paneCount = i;
+      break;
+    }
+
+    glfwSwapInterval(0);
+    glfwSetWindowUserPointer(pane->window, pane);
+    glfwSetFramebufferSizeCallback(pane->window, setFramebufferSize);
+    glfwSetScrollCallback(pane->window, onScroll);
+    glfwSetKeyCallback(pane->window, onKeyPress);
+    budgetInit(&pane->budget, frameBudget);
+    pane->view = v;
+    pane->shown = v;
+    pane->rendered = v;
+    pane->measured = v;
+    pane->hasRendered = 0;
+    pane->done = NULL;
+  }
+
+  glfwMakeContextCurrent(primary->window);
+  tick = time(NULL);
+  equalize = primary->renderer.histogram.cdf != 0;
+
+  store = openTileStore();
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  prefetcher = prefetchStart(store, cpus > 1 ? cpus - 1 : 1);
+  if (autoLimit)
+    prefetchLimit(prefetcher, &limit);
+  if (store)
+    printf("[Info] Tile store: %zu tiles\n", tileStoreCount(store));
+
+  /* Before the first frame, which gives the target its window size. */
+  if (!overviewInit(&primary->overview, &primary->renderer, store,
+                    &primary->view))
+    puts("[Info] No overview");
+  for (unsigned int i = 1; i < paneCount; i++) {
+    glfwMakeContextCurrent(panes[i].window);
+    overviewShare(&panes[i].overview, &primary->overview);
+  }
+  glfwMakeContextCurrent(primary->window);
+
+  /* Edited shaders build in the background, see reload.h. */
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  compiler = glfwCreateWindow(1, 1, "Wilk shaders", NULL, primary->window);
+  reloader = compiler ? reloadStart("src/shader", compiler,
+                                    primary->renderer.programs)
+                      : NULL;
+
+  if (ringName) {
+    ring = frameRingCreate(ringName, ringWidth, ringHeight, 3);
+    if (ring)
+      printf("[Info] Publishing frames to shared memory %s\n", ringName);
+  }
+
+  if (videoPath) {
+    video = fopen(videoPath, "wb");
+    if (!video)
+      fprintf(stderr, "[Error] Unable to open %s\n", videoPath);
+  }
+
+  if (profilePath) {
+    profile = fopen(profilePath, "w");
+    if (profile)
+      fputs("frame,seconds,frame_ms,counted,iterations,escaped,capped,"
+            "mean,max\n",
+            profile);
+    else
+      fprintf(stderr, "[Error] Unable to open %s\n", profilePath);
+  }
+
+  readbackInit(&readback, onReadback);
+  lastTime = startTime = glfwGetTime();
+
+  while (!quit) {
+    /* Scratch memory of the last frame goes all at once. */
+    arenaReset(arena);
+
+    /* New programs render every view again, the main context is current
+     * from the last frame. */
+    if (reloadPoll(reloader)) {
+      for (unsigned int i = 0; i < paneCount; i++) {
+        panes[i].hasRendered = 0;
+        panes[i].renderer.busy = 0;
+      }
+    }
 
     if (time(NULL) > tick) {
       fps = avg;
       avg = 0;
 
-      sprintf(title, "Wilk (%u FPS, [%.2f, %.2f] xy, %.2f%% scale, %.2f mit)",
-              fps, x, y, scale * 100, maxInterations);
-      glfwSetWindowTitle(window, title);
+      for (unsigned int i = 0; i < paneCount; i++)
+        setTitle(&panes[i], fps);
 
       tick = time(NULL);
     }
 
-    glUseProgram(program);
-    glfwGetWindowSize(window, (int *)&width, (int *)&height);
+    frameTime = glfwGetTime();
 
-    glUniform2d(glGetUniformLocation(program, "limits"), width, height);
-    glUniform2d(glGetUniformLocation(program, "loc"), x, y);
-    glUniform1d(glGetUniformLocation(program, "scale"), scale);
-    glUniform1d(glGetUniformLocation(program, "maxIterations"), maxInterations);
+    /* Every window renders a frame before any of them is swapped, so their
+     * GPU work is submitted back to back. */
+    for (unsigned int i = paneCount; i-- > 0;) {
+      glfwMakeContextCurrent(panes[i].window);
+      paneFrame(&panes[i], store, i ? NULL : &readback,
+                frameTime - lastTime);
+    }
 
-    glBindVertexArray(vao);
+    /* The loop above ends in the main window. Statistics arrive a frame or
+     * two late, a changed limit means one more render of the views. */
+    if (histogramCollect(&primary->renderer.histogram, bins) && autoLimit &&
+        limitFeedback(&limit, bins, primary->measured.maxIterations,
+                      primary->measured.scale))
+      followLimit();
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    /* Statistics describe the last render counted, a row per frame. */
+    if (profile) {
+      counted = statsCollect(&primary->renderer.stats, &stats);
+      fprintf(profile, "%lu,%.6f,%.3f,%d,%llu,%u,%u,%.2f,%u\n", frames++,
+              frameTime - startTime, (frameTime - lastTime) * 1000.0,
+              counted, (unsigned long long)stats.iterations, stats.escaped,
+              stats.capped, stats.mean, stats.max);
+    }
+    lastTime = frameTime;
 
-    glfwSwapBuffers(window);
+    for (unsigned int i = 0; i < paneCount; i++) {
+      glfwSwapBuffers(panes[i].window);
+      quit |= glfwWindowShouldClose(panes[i].window);
+    }
     glfwPollEvents();
     avg++;
+
+#ifndef NDEBUG
+    /* Steady state frames should fit in the arena as sized by the reset. */
+    if (arena->systemAllocations)
+      printf(" [Debug] Frame outgrew its arena (%zu KiB peak)\n",
+             arena->peak / 1024);
+#endif
   }
 
-  glDeleteProgram(program);
-  glDeleteBuffers(1, &vertexShader);
-  glDeleteBuffers(1, &fragmentShader);
+  reloadStop(reloader);
+  if (compiler)
+    glfwDestroyWindow(compiler);
+
+  readbackDestroy(&readback);
+  if (video)
+    fclose(video);
+  if (profile)
+    fclose(profile);
+
+  prefetchStop(prefetcher);
+  tileStoreClose(store);
+  frameRingDestroy(ring);
+
+  for (unsigned int i = paneCount; i-- > 0;) {
+    glfwMakeContextCurrent(panes[i].window);
+    if (panes[i].done)
+      glDeleteSync(panes[i].done);
+    overviewDestroy(&panes[i].overview);
+    rendererDestroy(&panes[i].renderer);
+  }
   glfwTerminate();
   return 0;
+}
+
+/* Output paths of the batch jobs still being read back, indexed by the
+ * readback targets. One more than can be in flight. */
+char batchOutputs[READBACK_BUFFERS + 1][PATH_MAX];
+unsigned int batchFailures = 0;
+
+void onBatchReadback(const void *pixels, uint32_t width, uint32_t height,
+                     const View *v, unsigned int targets) {
+  const char *path = batchOutputs[targets];
+
+  (void)v;
+
+  if (imageWriteRGBA(path, width, height, pixels)) {
+    printf("[Info] Wrote %s\n", path);
+  } else {
+    fprintf(stderr, "[Error] Unable to write %s\n", path);
+    batchFailures++;
+  }
+}
+
+/* Reads the next job from a job file, bad lines are reported and skipped.
+ * Returns 0 at the end of the file. */
+char readJob(FILE *fp, const char *name, const Job *defaults,
+             unsigned int *lineNumber, Job *job) {
+  char line[PATH_MAX + 1024];
+  int parsed;
+
+  while (fgets(line, sizeof(line), fp)) {
+    ++*lineNumber;
+    *job = *defaults;
+    parsed = jobParse(line, job);
+
+    if (parsed > 0)
+      return 1;
+
+    if (parsed < 0) {
+      fprintf(stderr, "[Error] %s:%u: skipping job\n", name, *lineNumber);
+      batchFailures++;
+    }
+  }
+
+  return 0;
+}
+
+/* Renders every job in fp, or just the defaults without one, with a single
+ * hidden context. The frame of a job is read back while the next ones
+ * render, the frames of a sweep only change uniforms in between. */
+int batch(FILE *fp, const char *name, const Job *defaults) {
+  Renderer renderer = {0};
+  GLFWwindow *window;
+  GLuint fbo, colour;
+  GLint maxSize;
+  TileStore *store;
+  Readback readback;
+  unsigned int lineNumber = 0, jobs = 0;
+  uint32_t width = 0, height = 0, frame = 0;
+  Job job, sweep = {0};
+
+  window = createWindow(0, NULL, &renderer, NULL);
+  if (!window)
+    return 1;
+
+  /* Frames are coloured here instead of the hidden window. */
+  glGenFramebuffers(1, &fbo);
+  glGenRenderbuffers(1, &colour);
+  glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxSize);
+
+  store = openTileStore();
+  readbackInit(&readback, onBatchReadback);
+
+  for (;;) {
+    unsigned int slot = jobs % (READBACK_BUFFERS + 1);
+
+    arenaReset(arenaThread());
+
+    if (frame < sweep.frames) {
+      job = sweep;
+    } else if (!fp) {
+      if (lineNumber++)
+        break;
+      job = *defaults;
+    } else if (!readJob(fp, name, defaults, &lineNumber, &job)) {
+      break;
+    }
+
+    if (job.frames) {
+      if (frame >= sweep.frames) {
+        sweep = job;
+        frame = 0;
+      }
 
-error:
-  glDeleteProgram(program);
-  glDeleteShader(vertexShader);
-  glDeleteShader(fragmentShader);
-  glDeleteBuffers(1, &vertexShader);
-  glDeleteBuffers(1, &fragmentShader);
+      if (!jobFrame(&sweep, frame++, &job)) {
+        fprintf(stderr, "[Error] %s: output path too long\n", sweep.output);
+        batchFailures++;
+        continue;
+      }
+    }
+
+    if (job.width > (GLuint)maxSize || job.height > (GLuint)maxSize) {
+      fprintf(stderr, "[Error] %s: %ux%u is larger than %d pixels\n",
+              job.output, job.width, job.height, maxSize);
+      batchFailures++;
+      continue;
+    }
+
+    if (job.width != width || job.height != height) {
+      glBindRenderbuffer(GL_RENDERBUFFER, colour);
+      glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, job.width, job.height);
+      glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                GL_RENDERBUFFER, colour);
+      width = job.width;
+      height = job.height;
+    }
+
+    rendererResize(&renderer, width, height);
+    if (!rendererUpload(&renderer, store, &job.view))
+      rendererIterate(&renderer, &job.view);
+
+    if (job.equalize)
+      rendererEqualize(&renderer, &job.view);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    rendererColour(&renderer, &job.view, &job.view, width, height,
+                   job.equalize);
+
+    strcpy(batchOutputs[slot], job.output);
+    readbackStart(&readback, width, height, &job.view, slot, 1);
+    readbackPoll(&readback, 0);
+    jobs++;
+  }
+
+  readbackDestroy(&readback);
+  tileStoreClose(store);
+  glDeleteRenderbuffers(1, &colour);
+  glDeleteFramebuffers(1, &fbo);
+  rendererDestroy(&renderer);
   glfwTerminate();
-  return -1;
+
+  printf("[Info] Rendered %u jobs\n", jobs);
+  return batchFailures ? 1 : 0;
+}
+
+/* Renders the view with the workers of a render farm and writes a PPM. */
+int coordinate(const char *address, uint32_t width, uint32_t height,
+               const char *output) {
+  TileKey key;
+  float *data;
+  char ok;
+
+  viewTileKey(&view, width, height, TILE_FORMAT_F32, &key);
+
+  data = malloc((size_t)width * height * sizeof(*data));
+  if (!data) {
+    fputs("[Error] Not enough memory for the render\n", stderr);
+    return 1;
+  }
+
+  ok = farmCoordinate(address, &key, data) &&
+       imageWritePPM(output, &key, data);
+  free(data);
+
+  if (!ok) {
+    fprintf(stderr, "[Error] Unable to render %s\n", output);
+    return 1;
+  }
+
+  printf("[Info] Wrote %s\n", output);
+  return 0;
+}
+
+void usage(const char *name) {
+  printf("Usage: %s [options]\n"
+         "\n"
+         "View:\n"
+         "  --center X,Y           centre of the view\n"
+         "  --scale S              zoom, the view spans 4 / S\n"
+         "  --iterations N         iteration limit, or auto to follow the "
+         "zoom\n"
+         "  --distance             distance estimation instead of escape "
+         "time\n"
+         "  --julia X,Y            the Julia set of c = X + Yi\n"
+         "  --formula NAME         mandelbrot, ship, tricorn, cubic, quartic "
+         "or custom\n"
+         "  --formula-file PATH    load and use a custom formula, see "
+         "formula.h\n"
+         "  --chunk N              GPU iterations per dispatch (1024), 0 for "
+         "one pass\n"
+         "  --frame-time MS        frame time to hold while moving (16), 0 "
+         "for full detail\n"
+         "  --render-scale S       part of the resolution rendered while "
+         "moving (1)\n"
+         "  --upscale FILTER       edge or bilinear, stretches smaller "
+         "renders\n"
+         "  --window X,Y,S         open another window on centre X,Y and "
+         "scale S\n"
+         "  --equalize             histogram equalised colours for --output "
+         "and --job\n"
+         "  --cache-size MB        disk space for computed tiles, 0 for no "
+         "limit (1024)\n"
+         "\n"
+         "Batch rendering:\n"
+         "  --output PATH          render the view to a PPM and exit\n"
+         "  --job FILE             render every line of FILE (- for stdin)\n"
+         "  --size WxH             size of the renders (4096x4096)\n"
+         "\n"
+         "A job line overrides the view with the words center=X,Y scale=S\n"
+         "iterations=N|auto size=WxH output=PATH distance equalize julia=X,Y\n"
+         "formula=NAME and sweeps c to sweep=X,Y over frames=N numbered "
+         "outputs.\n"
+         "\n"
+         "Render farm:\n"
+         "  --coordinator ADDRESS  hand out tiles to workers on ADDRESS\n"
+         "  --worker ADDRESS       render tiles for the coordinator on "
+         "ADDRESS\n"
+         "\n"
+         "--size and --output apply to farm renders too. ADDRESS is\n"
+         "unix:<path> or <host>:<port>.\n"
+         "\n"
+         "Output:\n"
+         "  --shm NAME             publish frames to POSIX shared memory "
+         "NAME\n"
+         "  --shm-size WxH         largest frame in shared memory "
+         "(3840x2160)\n"
+         "  --record PATH          append every frame to a PPM stream (a "
+         "file or FIFO)\n"
+         "  --profile PATH         write frame times and iteration totals "
+         "as CSV\n"
+         "\n"
+         "A toggles the automatic iteration limit, F cycles the formulas, M\n"
+         "the Julia set of the centre, [ and ] change the render scale, U the\n"
+         "upscale filter, V the overview, C colours by iterations spent and\n"
+         "F12 saves a screenshot. Keys and the mouse act on the view of their\n"
+         "window.\n",
+         name);
+}
+
+int main(int argc, char **argv) {
+  static const struct option options[] = {
+      {"center", required_argument, NULL, 'c'},
+      {"julia", required_argument, NULL, 'J'},
+      {"formula", required_argument, NULL, 'F'},
+      {"formula-file", required_argument, NULL, 'P'},
+      {"scale", required_argument, NULL, 's'},
+      {"iterations", required_argument, NULL, 'i'},
+      {"distance", no_argument, NULL, 'd'},
+      {"coordinator", required_argument, NULL, 'C'},
+      {"worker", required_argument, NULL, 'W'},
+      {"size", required_argument, NULL, 'S'},
+      {"output", required_argument, NULL, 'o'},
+      {"shm", required_argument, NULL, 'm'},
+      {"shm-size", required_argument, NULL, 'M'},
+      {"record", required_argument, NULL, 'r'},
+      {"equalize", no_argument, NULL, 'e'},
+      {"job", required_argument, NULL, 'j'},
+      {"chunk", required_argument, NULL, 'k'},
+      {"frame-time", required_argument, NULL, 'f'},
+      {"render-scale", required_argument, NULL, 'R'},
+      {"upscale", required_argument, NULL, 'u'},
+      {"window", required_argument, NULL, 'w'},
+      {"profile", required_argument, NULL, 'p'},
+      {"cache-size", required_argument, NULL, 'z'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}};
+  const char *coordinator = NULL, *worker = NULL, *output = NULL,
+             *jobPath = NULL;
+  unsigned int width = 4096, height = 4096;
+  char equalizeJobs = 0, *end;
+  int option;
+
+  while ((option = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+    switch (option) {
+    case 'c':
+      if (sscanf(optarg, "%lf,%lf", &view.x, &view.y) != 2)
+        goto usage;
+      break;
+    case 'F':
+      if (!formulaParse(optarg, &view.formula))
+        goto usage;
+      break;
+    case 'P':
+      if (!formulaLoad(optarg, &view.formula))
+        return 1;
+      break;
+    case 'J':
+      if (sscanf(optarg, "%lf,%lf", &view.cx, &view.cy) != 2)
+        goto usage;
+      view.julia = 1;
+      break;
+    case 's':
+      view.scale = atof(optarg);
+      if (!(view.scale > 0.0))
+        goto usage;
+      break;
+    case 'i':
+      autoLimit = strcmp(optarg, "auto") == 0;
+      if (!autoLimit)
+        view.maxIterations = atof(optarg);
+      break;
+    case 'd':
+      view.kernel = KERNEL_DISTANCE;
+      break;
+    case 'C':
+      coordinator = optarg;
+      break;
+    case 'W':
+      worker = optarg;
+      break;
+    case 'S':
+      if (sscanf(optarg, "%ux%u", &width, &height) != 2 || !width || !height)
+        goto usage;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    case 'm':
+      ringName = optarg;
+      break;
+    case 'r':
+      videoPath = optarg;
+      break;
+    case 'p':
+      profilePath = optarg;
+      break;
+    case 'z':
+      /* In MiB, strtoull alone would take signs, junk and overflow. */
+      storeCapacity = strtoull(optarg, &end, 10);
+      if (*optarg < '0' || *optarg > '9' || *end ||
+          storeCapacity > UINT64_MAX >> 20)
+        goto usage;
+      storeCapacity <<= 20;
+      break;
+    case 'M':
+      if (sscanf(optarg, "%ux%u", &ringWidth, &ringHeight) != 2 ||
+          !ringWidth || !ringHeight)
+        goto usage;
+      break;
+    case 'e':
+      equalizeJobs = 1;
+      break;
+    case 'j':
+      jobPath = optarg;
+      break;
+    case 'k':
+      chunkIterations = strtoul(optarg, NULL, 10);
+      break;
+    case 'f':
+      frameBudget = atof(optarg) / 1000.0;
+      break;
+    case 'R':
+      renderScale = atof(optarg);
+      if (renderScale < BUDGET_MIN_RESOLUTION || renderScale > 1.0)
+        goto usage;
+      break;
+    case 'u':
+      if (strcmp(optarg, "edge") == 0)
+        upscale = UPSCALE_EDGE;
+      else if (strcmp(optarg, "bilinear") == 0)
+        upscale = UPSCALE_BILINEAR;
+      else
+        goto usage;
+      break;
+    case 'w':
+      if (paneCount == MAX_PANES) {
+        fprintf(stderr, "[Error] At most %d windows\n", MAX_PANES);
+        return 1;
+      }
+      if (sscanf(optarg, "%lf,%lf,%lf", &panes[paneCount].view.x,
+                 &panes[paneCount].view.y,
+                 &panes[paneCount].view.scale) != 3 ||
+          !(panes[paneCount].view.scale > 0.0))
+        goto usage;
+      paneCount++;
+      break;
+    case 'h':
+      usage(argv[0]);
+      return 0;
+    default:
+      goto usage;
+    }
+  }
+
+  if (optind != argc)
+    goto usage;
+
+  if (view.kernel == KERNEL_DISTANCE &&
+      FORMULA_INDEX(view.formula) == FORMULA_CUSTOM) {
+    fprintf(stderr, "[Error] Custom formulas have no distance estimate\n");
+    return 1;
+  }
+
+  if (autoLimit)
+    view.maxIterations = limitFor(&limit, view.scale);
+
+  if (worker)
+    return farmWork(worker) ? 0 : 1;
+
+  if (coordinator)
+    return coordinate(coordinator, width, height,
+                      output ? output : "wilk.ppm");
+
+  if (jobPath || output) {
+    Job defaults = {view, width, height, equalizeJobs, autoLimit,
+                    "wilk.ppm", 0.0, 0.0, 0};
+    FILE *fp;
+    int status;
+
+    if (output) {
+      if (strlen(output) >= sizeof(defaults.output))
+        goto usage;
+      strcpy(defaults.output, output);
+    }
+
+    /* A lone --output renders the command line view. */
+    if (!jobPath)
+      return batch(NULL, NULL, &defaults);
+
+    if (strcmp(jobPath, "-") == 0)
+      return batch(stdin, "stdin", &defaults);
+
+    fp = fopen(jobPath, "r");
+    if (!fp) {
+      fprintf(stderr, "[Error] Unable to open %s\n", jobPath);
+      return 1;
+    }
+
+    status = batch(fp, jobPath, &defaults);
+    fclose(fp);
+    return status;
+  }
+
+  return interactive();
+
+usage:
+  usage(argv[0]);
+  return 1;
 }
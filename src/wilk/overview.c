@@ -0,0 +1,211 @@
+#include <wilk/arena.h>
+#include <wilk/kernel.h>
+#include <wilk/overview.h>
+#include <wilk/pack.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Escape time detail of the picture, enough to show the filaments. */
+#define OVERVIEW_ITERATIONS 256.0
+/* Part of the shorter window side it takes, and its distance from the
+ * corner in pixels. */
+#define OVERVIEW_SHARE 0.25
+#define OVERVIEW_MARGIN 8
+/* Outlines never get smaller than this, a deep zoom is a dot. */
+#define OUTLINE_MIN 3
+
+/* Renders the tile on the CPU and keeps it in the store. */
+static void cache(TileStore *store, const View *view) {
+  Arena *arena = arenaThread();
+  ArenaMark mark = arenaMark(arena);
+  TileKey key;
+  unsigned char *packed;
+  float *data;
+  size_t size;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  viewTileKey(view, OVERVIEW_SIZE, OVERVIEW_SIZE, TILE_FORMAT_F32, &key);
+  data = arenaAlloc(arena, (size_t)OVERVIEW_SIZE * OVERVIEW_SIZE *
+                               sizeof(*data));
+  packed = arenaAlloc(arena, packBound(&key));
+
+  if (data && packed &&
+      kernelRenderParallel(&key, data, cpus > 0 ? cpus : 1)) {
+    size = packEncode(&key, data, packed);
+    key.format = TILE_FORMAT_PACKED;
+    if (size)
+      tileStorePut(store, &key, packed, size);
+  }
+
+  arenaRewind(arena, mark);
+}
+
+/* Lets go of the picture, the last user deletes it. */
+static void release(Overview *overview) {
+  OverviewPicture *picture = overview->picture;
+
+  if (picture && !--picture->users) {
+    glDeleteTextures(1, &picture->texture);
+    free(picture);
+  }
+  overview->picture = NULL;
+}
+
+/* Gives the overview a new picture of the set of view. */
+static char paint(Overview *overview, Renderer *renderer, TileStore *store,
+                  const View *view) {
+  OverviewPicture *picture = calloc(1, sizeof(*picture));
+  View *shows;
+
+  /* Gives up on the overview for good, not to try again every frame. */
+  if (!picture) {
+    overviewDestroy(overview);
+    return 0;
+  }
+
+  shows = &picture->view;
+  *shows = *view;
+  shows->x = 0.0;
+  shows->y = 0.0;
+  shows->scale = 1.0;
+  shows->maxIterations = OVERVIEW_ITERATIONS;
+  shows->kernel = KERNEL_ESCAPE_TIME;
+  picture->users = 1;
+
+  rendererResize(renderer, OVERVIEW_SIZE, OVERVIEW_SIZE);
+  if (!rendererUpload(renderer, store, shows)) {
+    if (store)
+      cache(store, shows);
+    if (!rendererUpload(renderer, store, shows))
+      rendererIterate(renderer, shows);
+  }
+  rendererEqualize(renderer, shows);
+
+  glGenTextures(1, &picture->texture);
+  glBindTexture(GL_TEXTURE_2D, picture->texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, OVERVIEW_SIZE, OVERVIEW_SIZE, 0,
+               GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  release(overview);
+  overview->picture = picture;
+
+  if (!overview->fbo)
+    glGenFramebuffers(1, &overview->fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, overview->fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         picture->texture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    overviewDestroy(overview);
+    return 0;
+  }
+
+  rendererColour(renderer, shows, shows, OVERVIEW_SIZE, OVERVIEW_SIZE,
+                 renderer->histogram.cdf != 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  return 1;
+}
+
+char overviewInit(Overview *overview, Renderer *renderer, TileStore *store,
+                  const View *view) {
+  memset(overview, 0, sizeof(*overview));
+  return paint(overview, renderer, store, view);
+}
+
+char overviewUpdate(Overview *overview, Renderer *renderer, TileStore *store,
+                    const View *shown) {
+  /* Without framebuffers there never was a picture to update. */
+  if (!overview->fbo ||
+      (overview->picture && viewSameSet(&overview->picture->view, shown)))
+    return 0;
+
+  /* Windows sharing the old picture keep it. */
+  paint(overview, renderer, store, shown);
+  return 1;
+}
+
+void overviewShare(Overview *overview, const Overview *from) {
+  memset(overview, 0, sizeof(*overview));
+  if (!from->picture)
+    return;
+
+  overview->picture = from->picture;
+  overview->picture->users++;
+
+  glGenFramebuffers(1, &overview->fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, overview->fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         overview->picture->texture, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void overviewDestroy(Overview *overview) {
+  glDeleteFramebuffers(1, &overview->fbo);
+  overview->fbo = 0;
+  release(overview);
+}
+
+/* Clears the part of a rectangle inside clip, both as x0, y0, x1, y1. */
+static void fill(int x0, int y0, int x1, int y1, const int clip[4]) {
+  x0 = x0 > clip[0] ? x0 : clip[0];
+  y0 = y0 > clip[1] ? y0 : clip[1];
+  x1 = x1 < clip[2] ? x1 : clip[2];
+  y1 = y1 < clip[3] ? y1 : clip[3];
+  if (x0 >= x1 || y0 >= y1)
+    return;
+
+  glScissor(x0, y0, x1 - x0, y1 - y0);
+  glClear(GL_COLOR_BUFFER_BIT);
+}
+
+/* Pixel of an outline edge, those off the picture land just outside it. */
+static int edge(double x, int low, int high) {
+  return (int)floor(fmin(fmax(x, low - 1.0), high + 1.0));
+}
+
+void overviewDraw(const Overview *overview, const View *shown, uint32_t width,
+                  uint32_t height) {
+  const View *picture;
+  int side = (int)((width < height ? width : height) * OVERVIEW_SHARE);
+  int box[4], x0, y0, x1, y1;
+  double extent, cx, cy;
+
+  if (!overview->fbo || !overview->picture || side < 2 * OUTLINE_MIN ||
+      !viewSameSet(&overview->picture->view, shown))
+    return;
+
+  picture = &overview->picture->view;
+
+  box[0] = (int)width - side - OVERVIEW_MARGIN;
+  box[1] = (int)height - side - OVERVIEW_MARGIN;
+  box[2] = box[0] + side;
+  box[3] = box[1] + side;
+
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, overview->fbo);
+  glBlitFramebuffer(0, 0, OVERVIEW_SIZE, OVERVIEW_SIZE, box[0], box[1],
+                    box[2], box[3], GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+  /* Both views span 4 / scale, as in wilk.frag. */
+  extent = fmax(side * picture->scale / shown->scale, OUTLINE_MIN);
+  cx = box[0] + side * (0.5 + (shown->x - picture->x) * picture->scale / 4.0);
+  cy = box[1] + side * (0.5 + (shown->y - picture->y) * picture->scale / 4.0);
+  x0 = edge(cx - extent / 2.0, box[0], box[2]);
+  y0 = edge(cy - extent / 2.0, box[1], box[3]);
+  x1 = edge(cx + extent / 2.0, box[0], box[2]);
+  y1 = edge(cy + extent / 2.0, box[1], box[3]);
+
+  glEnable(GL_SCISSOR_TEST);
+  glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+  fill(x0, y0, x1, y0 + 1, box);
+  fill(x0, y1 - 1, x1, y1, box);
+  fill(x0, y0, x0 + 1, y1, box);
+  fill(x1 - 1, y0, x1, y1, box);
+  glDisable(GL_SCISSOR_TEST);
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
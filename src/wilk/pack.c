@@ -0,0 +1,176 @@
+#include <wilk/arena.h>
+#include <wilk/codec.h>
+#include <wilk/kernel.h>
+#include <wilk/pack.h>
+
+#include <math.h>
+#include <string.h>
+
+enum { PACK_COUNTS = 1, PACK_FRACTION = 2 };
+
+/* Special words of PACK_COUNTS. */
+#define WORD_OVERFLOW 0xfffeu
+#define WORD_CAP 0xffffu
+/* With more overflows than this counts are quantised like fractions. */
+#define MAX_OVERFLOW_SHARE 64
+
+typedef struct {
+  uint32_t encoding;
+  uint32_t count;
+  uint32_t overflow; /* entries after the coded words */
+  uint32_t codedSize;
+} PackHeader;
+
+typedef struct {
+  uint32_t index;
+  float value;
+} Overflow;
+
+static size_t pixels(const TileKey *key) {
+  return (size_t)key->width * key->height;
+}
+
+/* The range the quantised words span. */
+static double fractionUnit(const TileKey *key) {
+  return key->kernel == KERNEL_DISTANCE ? DISTANCE_FAR : key->maxIterations;
+}
+
+size_t packBound(const TileKey *key) {
+  return sizeof(PackHeader) + codecBound16(pixels(key)) +
+         pixels(key) / MAX_OVERFLOW_SHARE * sizeof(Overflow);
+}
+
+/* Escape time counts fit PACK_COUNTS unless too many overflow. */
+static char exactCounts(const TileKey *key, const float *in, size_t count) {
+  size_t overflow = 0;
+
+  if (key->kernel != KERNEL_ESCAPE_TIME)
+    return 0;
+
+  for (size_t i = 0; i < count; i++) {
+    if (in[i] < 0.0f || in[i] != floorf(in[i]))
+      return 0;
+
+    if (in[i] >= WORD_OVERFLOW && in[i] < key->maxIterations &&
+        ++overflow > count / MAX_OVERFLOW_SHARE)
+      return 0;
+  }
+
+  return 1;
+}
+
+/* Cuts the tile to 16 bit words, returns the encoding used. */
+static uint32_t quantise(const TileKey *key, const float *in, size_t count,
+                         uint16_t *words) {
+  double unit = fractionUnit(key);
+
+  if (exactCounts(key, in, count)) {
+    for (size_t i = 0; i < count; i++) {
+      if (in[i] >= key->maxIterations)
+        words[i] = WORD_CAP;
+      else if (in[i] >= WORD_OVERFLOW)
+        words[i] = WORD_OVERFLOW;
+      else
+        words[i] = (uint16_t)in[i];
+    }
+
+    return PACK_COUNTS;
+  }
+
+  /* 0 stays exact, it is the interior of the distance kernel. */
+  for (size_t i = 0; i < count; i++) {
+    double q = round(in[i] / unit * 65535.0);
+
+    words[i] = in[i] <= 0.0f ? 0 : q < 1.0 ? 1 : q > 65535.0 ? 65535 : q;
+  }
+
+  return PACK_FRACTION;
+}
+
+size_t packEncode(const TileKey *key, const float *in, unsigned char *out) {
+  PackHeader header = {0};
+  size_t count = pixels(key);
+  Arena *arena = arenaThread();
+  ArenaMark mark = arenaMark(arena);
+  unsigned char *p = out + sizeof(header);
+  uint16_t *words;
+
+  if (!count || !(words = arenaAlloc(arena, count * sizeof(*words))))
+    return 0;
+
+  header.count = count;
+  header.encoding = quantise(key, in, count, words);
+  header.codedSize = codecEncode16(words, count, p);
+  p += header.codedSize;
+
+  for (size_t i = 0; header.encoding == PACK_COUNTS && i < count; i++) {
+    Overflow entry = {i, in[i]};
+
+    if (words[i] != WORD_OVERFLOW)
+      continue;
+
+    memcpy(p, &entry, sizeof(entry));
+    p += sizeof(entry);
+    header.overflow++;
+  }
+
+  memcpy(out, &header, sizeof(header));
+  arenaRewind(arena, mark);
+  return p - out;
+}
+
+char packDecode(const TileKey *key, const unsigned char *in, size_t size,
+                float *out) {
+  PackHeader header;
+  size_t count = pixels(key);
+  const unsigned char *overflow;
+  unsigned char *words;
+  uint16_t word;
+
+  if (size < sizeof(header))
+    return 0;
+
+  memcpy(&header, in, sizeof(header));
+  if (header.count != count || header.codedSize > size - sizeof(header) ||
+      size - sizeof(header) - header.codedSize !=
+          header.overflow * sizeof(Overflow))
+    return 0;
+
+  /* The words are decoded into the back half of out and widened front to
+   * back, out[i] only ever overwrites words before word i. */
+  words = (unsigned char *)out + count * sizeof(word);
+  if (!codecDecode16(in + sizeof(header), header.codedSize,
+                     (uint16_t *)words, count))
+    return 0;
+
+  overflow = in + sizeof(header) + header.codedSize;
+
+  if (header.encoding == PACK_COUNTS) {
+    float cap = key->maxIterations;
+
+    for (size_t i = 0; i < count; i++) {
+      memcpy(&word, words + i * sizeof(word), sizeof(word));
+      out[i] = word < WORD_OVERFLOW ? word : cap;
+    }
+
+    for (uint32_t i = 0; i < header.overflow; i++) {
+      Overflow entry;
+
+      memcpy(&entry, overflow + i * sizeof(entry), sizeof(entry));
+      if (entry.index >= count)
+        return 0;
+      out[entry.index] = entry.value;
+    }
+  } else if (header.encoding == PACK_FRACTION) {
+    float unit = fractionUnit(key), step = unit / 65535.0f;
+
+    for (size_t i = 0; i < count; i++) {
+      memcpy(&word, words + i * sizeof(word), sizeof(word));
+      out[i] = word == 65535 ? unit : word * step;
+    }
+  } else {
+    return 0;
+  }
+
+  return 1;
+}
@@ -0,0 +1,371 @@
+#define _GNU_SOURCE
+#include <wilk/arena.h>
+#include <wilk/curve.h>
+#include <wilk/kernel.h>
+#include <wilk/pack.h>
+#include <wilk/prefetch.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Views rendered ahead for steady navigation, one for a single step. */
+#define PREFETCH_DEPTH 3
+#define MAX_JOBS (2 * PREFETCH_DEPTH)
+#define MAX_THREADS 64
+#define HISTORY 8
+/* Motions older than this do not count as navigation anymore. */
+#define MOTION_WINDOW 0.75
+
+/* Blocks go out along a Hilbert curve so the workers of a job share the
+ * neighbourhood of the orbits they compute. */
+typedef struct {
+  TileKey key;
+  float *data;
+  uint32_t *order;
+  uint32_t columns, blocks, nextBlock, blocksLeft;
+  char active;
+} Job;
+
+struct Prefetcher {
+  TileStore *store;
+  pthread_t threads[MAX_THREADS];
+  unsigned int threadCount;
+
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  char quit;
+
+  Motion history[HISTORY];
+  double historyTime[HISTORY];
+  unsigned int historyCount, motionSerial, observedSerial;
+
+  View observed;
+  uint32_t observedWidth, observedHeight;
+
+  IterationLimit limit;
+  char autoLimit;
+
+  Job jobs[MAX_JOBS];
+};
+
+static double now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static char motionEquals(const Motion *a, const Motion *b) {
+  return a->panX == b->panX && a->panY == b->panY && a->zoom == b->zoom &&
+         a->pivotX == b->pivotX && a->pivotY == b->pivotY &&
+         a->iterations == b->iterations;
+}
+
+/* Visible frames come from the GPU, keep the CPU work out of their way. */
+static void lowerPriority(void) {
+  struct sched_param param = {0};
+
+  if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0)
+    setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+}
+
+/* Picks the next block to render, caller holds the mutex. */
+static Job *nextJob(Prefetcher *prefetcher, uint32_t *block) {
+  for (int i = 0; i < MAX_JOBS; i++) {
+    Job *job = &prefetcher->jobs[i];
+
+    if (job->active && job->nextBlock < job->blocks) {
+      *block = job->order[job->nextBlock++];
+      return job;
+    }
+  }
+
+  return NULL;
+}
+
+/* Tiles are stored packed, see pack.h. */
+static void storedKey(const TileKey *key, TileKey *stored) {
+  *stored = *key;
+  stored->format = TILE_FORMAT_PACKED;
+}
+
+static void publish(TileStore *store, const TileKey *key, const float *data) {
+  Arena *arena = arenaThread();
+  unsigned char *packed = arenaAlloc(arena, packBound(key));
+  TileKey stored;
+  size_t size;
+
+  if (packed) {
+    storedKey(key, &stored);
+    size = packEncode(key, data, packed);
+    if (size)
+      tileStorePut(store, &stored, packed, size);
+  }
+
+  /* A tile is the unit of work of this thread. */
+  arenaReset(arena);
+}
+
+static void dropJob(Job *job) {
+  free(job->data);
+  free(job->order);
+  job->data = NULL;
+  job->order = NULL;
+  job->active = 0;
+}
+
+static void *worker(void *arg) {
+  Prefetcher *prefetcher = arg;
+
+  lowerPriority();
+  pthread_mutex_lock(&prefetcher->mutex);
+
+  while (!prefetcher->quit) {
+    uint32_t block;
+    Job *job = nextJob(prefetcher, &block);
+
+    if (!job) {
+      pthread_cond_wait(&prefetcher->wake, &prefetcher->mutex);
+      continue;
+    }
+
+    pthread_mutex_unlock(&prefetcher->mutex);
+    kernelRenderRect(&job->key, block % job->columns * KERNEL_BLOCK,
+                     block / job->columns * KERNEL_BLOCK, KERNEL_BLOCK,
+                     KERNEL_BLOCK, job->data);
+    pthread_mutex_lock(&prefetcher->mutex);
+
+    if (--job->blocksLeft)
+      continue;
+
+    /* Last block done, publish without blocking the other workers. */
+    pthread_mutex_unlock(&prefetcher->mutex);
+    publish(prefetcher->store, &job->key, job->data);
+    pthread_mutex_lock(&prefetcher->mutex);
+
+    dropJob(job);
+  }
+
+  pthread_mutex_unlock(&prefetcher->mutex);
+  return NULL;
+}
+
+Prefetcher *prefetchStart(TileStore *store, unsigned int threads) {
+  Prefetcher *prefetcher;
+
+  if (!store || !threads)
+    return NULL;
+
+  prefetcher = calloc(1, sizeof(*prefetcher));
+  if (!prefetcher)
+    return NULL;
+
+  prefetcher->store = store;
+  pthread_mutex_init(&prefetcher->mutex, NULL);
+  pthread_cond_init(&prefetcher->wake, NULL);
+
+  if (threads > MAX_THREADS)
+    threads = MAX_THREADS;
+
+  for (unsigned int i = 0; i < threads; i++) {
+    if (pthread_create(&prefetcher->threads[i], NULL, worker, prefetcher))
+      break;
+    prefetcher->threadCount++;
+  }
+
+  if (!prefetcher->threadCount) {
+    prefetchStop(prefetcher);
+    return NULL;
+  }
+
+  return prefetcher;
+}
+
+void prefetchStop(Prefetcher *prefetcher) {
+  if (!prefetcher)
+    return;
+
+  pthread_mutex_lock(&prefetcher->mutex);
+  prefetcher->quit = 1;
+  pthread_cond_broadcast(&prefetcher->wake);
+  pthread_mutex_unlock(&prefetcher->mutex);
+
+  for (unsigned int i = 0; i < prefetcher->threadCount; i++)
+    pthread_join(prefetcher->threads[i], NULL);
+
+  for (int i = 0; i < MAX_JOBS; i++)
+    dropJob(&prefetcher->jobs[i]);
+
+  pthread_cond_destroy(&prefetcher->wake);
+  pthread_mutex_destroy(&prefetcher->mutex);
+  free(prefetcher);
+}
+
+void prefetchMotion(Prefetcher *prefetcher, const Motion *motion) {
+  unsigned int slot;
+
+  if (!prefetcher)
+    return;
+
+  pthread_mutex_lock(&prefetcher->mutex);
+  slot = prefetcher->historyCount++ % HISTORY;
+  prefetcher->history[slot] = *motion;
+  prefetcher->historyTime[slot] = now();
+  prefetcher->motionSerial++;
+  pthread_mutex_unlock(&prefetcher->mutex);
+}
+
+void prefetchLimit(Prefetcher *prefetcher, const IterationLimit *limit) {
+  if (!prefetcher)
+    return;
+
+  pthread_mutex_lock(&prefetcher->mutex);
+  prefetcher->autoLimit = limit != NULL;
+  if (limit)
+    prefetcher->limit = *limit;
+  /* Predictions made with the old limit are stale. */
+  prefetcher->motionSerial++;
+  pthread_mutex_unlock(&prefetcher->mutex);
+}
+
+/* Extrapolates the recent motions, caller holds the mutex. */
+static int predict(Prefetcher *prefetcher, View *views) {
+  const Motion *last, *previous;
+  unsigned int count = prefetcher->historyCount;
+  double t = now();
+  int depth;
+
+  if (!count)
+    return 0;
+
+  last = &prefetcher->history[(count - 1) % HISTORY];
+  if (t - prefetcher->historyTime[(count - 1) % HISTORY] > MOTION_WINDOW)
+    return 0;
+
+  depth = 1;
+  if (count > 1) {
+    previous = &prefetcher->history[(count - 2) % HISTORY];
+
+    if (motionEquals(last, previous) &&
+        t - prefetcher->historyTime[(count - 2) % HISTORY] < MOTION_WINDOW)
+      depth = PREFETCH_DEPTH;
+  }
+
+  for (int i = 0; i < depth; i++) {
+    views[i] = i ? views[i - 1] : prefetcher->observed;
+    viewApply(&views[i], last);
+    if (prefetcher->autoLimit)
+      views[i].maxIterations = limitFor(&prefetcher->limit, views[i].scale);
+  }
+
+  return depth;
+}
+
+static char queued(Prefetcher *prefetcher, const TileKey *key) {
+  for (int i = 0; i < MAX_JOBS; i++)
+    if (prefetcher->jobs[i].active &&
+        memcmp(&prefetcher->jobs[i].key, key, sizeof(*key)) == 0)
+      return 1;
+
+  return 0;
+}
+
+static void enqueue(Prefetcher *prefetcher, const TileKey *key) {
+  if (!kernelSupports(key))
+    return;
+
+  for (int i = 0; i < MAX_JOBS; i++) {
+    Job *job = &prefetcher->jobs[i];
+
+    if (job->active)
+      continue;
+
+    job->blocks = kernelBlockCount(key, &job->columns);
+    job->data = malloc((size_t)key->width * key->height * sizeof(float));
+    job->order = malloc(job->blocks * sizeof(*job->order));
+    if (!job->data || !job->order) {
+      dropJob(job);
+      return;
+    }
+
+    curveOrder(CURVE_HILBERT, job->columns, job->blocks / job->columns,
+               job->order);
+    job->key = *key;
+    job->nextBlock = 0;
+    job->blocksLeft = job->blocks;
+    job->active = 1;
+    return;
+  }
+}
+
+void prefetchObserve(Prefetcher *prefetcher, const View *view, uint32_t width,
+                     uint32_t height) {
+  View views[PREFETCH_DEPTH];
+  TileKey keys[PREFETCH_DEPTH];
+  int count;
+
+  if (!prefetcher || !width || !height)
+    return;
+
+  pthread_mutex_lock(&prefetcher->mutex);
+
+  if (prefetcher->observedSerial == prefetcher->motionSerial &&
+      prefetcher->observedWidth == width &&
+      prefetcher->observedHeight == height &&
+      viewEquals(&prefetcher->observed, view)) {
+    pthread_mutex_unlock(&prefetcher->mutex);
+    return;
+  }
+
+  prefetcher->observed = *view;
+  prefetcher->observedWidth = width;
+  prefetcher->observedHeight = height;
+  prefetcher->observedSerial = prefetcher->motionSerial;
+
+  count = predict(prefetcher, views);
+  for (int i = 0; i < count; i++)
+    viewTileKey(&views[i], width, height, TILE_FORMAT_F32, &keys[i]);
+
+  /* Drop predictions nobody started on that are no longer ahead of us. */
+  for (int i = 0; i < MAX_JOBS; i++) {
+    Job *job = &prefetcher->jobs[i];
+    char wanted = 0;
+
+    if (!job->active || job->nextBlock)
+      continue;
+
+    for (int k = 0; k < count; k++)
+      wanted |= memcmp(&job->key, &keys[k], sizeof(keys[k])) == 0;
+
+    if (!wanted)
+      dropJob(job);
+  }
+
+  pthread_mutex_unlock(&prefetcher->mutex);
+
+  /* Queue the nearest view first. */
+  for (int i = 0; i < count; i++) {
+    TileKey stored;
+    Tile tile;
+
+    storedKey(&keys[i], &stored);
+    if (tileStoreGet(prefetcher->store, &stored, &tile)) {
+      tileStoreRelease(&tile);
+      continue;
+    }
+
+    pthread_mutex_lock(&prefetcher->mutex);
+    if (!queued(prefetcher, &keys[i]))
+      enqueue(prefetcher, &keys[i]);
+    pthread_mutex_unlock(&prefetcher->mutex);
+  }
+
+  pthread_cond_broadcast(&prefetcher->wake);
+}
@@ -0,0 +1,84 @@
+#include <wilk/readback.h>
+
+#include <string.h>
+
+void readbackInit(Readback *readback, ReadbackConsumer consumer) {
+  memset(readback, 0, sizeof(*readback));
+  readback->consumer = consumer;
+  glGenBuffers(READBACK_BUFFERS, readback->buffers);
+}
+
+void readbackDestroy(Readback *readback) {
+  readbackPoll(readback, 1);
+  glDeleteBuffers(READBACK_BUFFERS, readback->buffers);
+  memset(readback->buffers, 0, sizeof(readback->buffers));
+}
+
+/* Consumes the oldest readback if it is done, returns 0 if it is not. */
+static char finishOldest(Readback *readback, char wait) {
+  unsigned int slot = (readback->head + READBACK_BUFFERS - readback->pending) %
+                      READBACK_BUFFERS;
+  size_t size = (size_t)readback->width[slot] * readback->height[slot] * 4;
+  GLenum status;
+  const void *pixels;
+
+  status = glClientWaitSync(readback->fences[slot],
+                            wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                            wait ? GL_TIMEOUT_IGNORED : 0);
+  if (status == GL_TIMEOUT_EXPIRED)
+    return 0;
+
+  glDeleteSync(readback->fences[slot]);
+  readback->fences[slot] = NULL;
+  readback->pending--;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffers[slot]);
+  pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+
+  if (pixels) {
+    readback->consumer(pixels, readback->width[slot], readback->height[slot],
+                       &readback->view[slot], readback->targets[slot]);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  return 1;
+}
+
+char readbackStart(Readback *readback, uint32_t width, uint32_t height,
+                   const View *view, unsigned int targets, char wait) {
+  unsigned int slot;
+  size_t size = (size_t)width * height * 4;
+
+  readbackPoll(readback, 0);
+
+  if (readback->pending == READBACK_BUFFERS &&
+      !(wait && finishOldest(readback, 1)))
+    return 0;
+
+  slot = readback->head;
+  readback->head = (readback->head + 1) % READBACK_BUFFERS;
+
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffers[slot]);
+  if (size > readback->capacity[slot]) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    readback->capacity[slot] = size;
+  }
+
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  readback->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  readback->width[slot] = width;
+  readback->height[slot] = height;
+  readback->view[slot] = *view;
+  readback->targets[slot] = targets;
+  readback->pending++;
+  return 1;
+}
+
+void readbackPoll(Readback *readback, char wait) {
+  while (readback->pending && finishOldest(readback, wait))
+    ;
+}
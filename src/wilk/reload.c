@@ -0,0 +1,202 @@
+#include <wilk/reload.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/* Sources that go into the programs, other files are ignored. */
+static const char *extensions[] = {".vert", ".frag", ".comp", ".glsl"};
+
+struct Reloader {
+  int fd;
+  GLFWwindow *window;
+  Programs *programs;
+  pthread_t thread;
+  char changed; /* sources changed since the last request */
+
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  char quit, requested, building, ready;
+  Programs snapshot; /* what the worker is asked to build */
+  uint32_t mask;
+  Programs fresh;
+  GLsync sync;
+};
+
+static char isShader(const char *name) {
+  size_t length = strlen(name);
+
+  for (size_t i = 0; i < sizeof(extensions) / sizeof(*extensions); i++) {
+    size_t tail = strlen(extensions[i]);
+
+    if (length > tail && strcmp(name + length - tail, extensions[i]) == 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+static void *worker(void *arg) {
+  Reloader *reloader = arg;
+  Programs fresh;
+  GLsync sync;
+  char ok;
+
+  glfwMakeContextCurrent(reloader->window);
+  pthread_mutex_lock(&reloader->mutex);
+
+  while (!reloader->quit) {
+    if (!reloader->requested) {
+      pthread_cond_wait(&reloader->wake, &reloader->mutex);
+      continue;
+    }
+
+    reloader->requested = 0;
+    reloader->building = 1;
+    pthread_mutex_unlock(&reloader->mutex);
+
+    puts("[Info] Rebuilding shaders");
+    ok = rendererBuildPrograms(&reloader->snapshot, reloader->mask, &fresh);
+    sync = NULL;
+    if (ok) {
+      /* The other contexts only see finished programs. */
+      sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      glFlush();
+    } else {
+      fprintf(stderr, "[Error] Shaders did not build, keeping the old ones\n");
+    }
+
+    pthread_mutex_lock(&reloader->mutex);
+    reloader->building = 0;
+    if (ok) {
+      reloader->fresh = fresh;
+      reloader->sync = sync;
+      reloader->ready = 1;
+    }
+  }
+
+  pthread_mutex_unlock(&reloader->mutex);
+  glfwMakeContextCurrent(NULL);
+  return NULL;
+}
+
+Reloader *reloadStart(const char *dir, GLFWwindow *window,
+                      Programs *programs) {
+  Reloader *reloader = calloc(1, sizeof(*reloader));
+
+  if (!reloader)
+    return NULL;
+
+  reloader->window = window;
+  reloader->programs = programs;
+  reloader->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+  if (reloader->fd < 0 ||
+      inotify_add_watch(reloader->fd, dir,
+                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+    fprintf(stderr, "[Error] Unable to watch %s: %s\n", dir, strerror(errno));
+    if (reloader->fd >= 0)
+      close(reloader->fd);
+    free(reloader);
+    return NULL;
+  }
+
+  pthread_mutex_init(&reloader->mutex, NULL);
+  pthread_cond_init(&reloader->wake, NULL);
+
+  if (pthread_create(&reloader->thread, NULL, worker, reloader)) {
+    fputs("[Error] Unable to start the shader worker\n", stderr);
+    pthread_cond_destroy(&reloader->wake);
+    pthread_mutex_destroy(&reloader->mutex);
+    close(reloader->fd);
+    free(reloader);
+    return NULL;
+  }
+
+  printf("[Info] Watching %s for shader changes\n", dir);
+  return reloader;
+}
+
+void reloadStop(Reloader *reloader) {
+  if (!reloader)
+    return;
+
+  pthread_mutex_lock(&reloader->mutex);
+  reloader->quit = 1;
+  pthread_cond_signal(&reloader->wake);
+  pthread_mutex_unlock(&reloader->mutex);
+  pthread_join(reloader->thread, NULL);
+
+  /* Built but never swapped in. */
+  if (reloader->ready) {
+    for (int i = 0; i < FORMULA_COUNT; i++) {
+      glDeleteProgram(reloader->fresh.wilk[i]);
+      glDeleteProgram(reloader->fresh.chunk[i]);
+    }
+    glDeleteProgram(reloader->fresh.colour);
+    glDeleteSync(reloader->sync);
+  }
+
+  pthread_cond_destroy(&reloader->wake);
+  pthread_mutex_destroy(&reloader->mutex);
+  close(reloader->fd);
+  free(reloader);
+}
+
+/* Drains the pending events, returns 1 if a shader source changed. */
+static char readEvents(int fd) {
+  char buffer[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *event;
+  char changed = 0;
+  ssize_t length;
+
+  while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+    for (char *p = buffer; p < buffer + length;
+         p += sizeof(*event) + event->len) {
+      event = (const struct inotify_event *)p;
+      if (event->len && isShader(event->name))
+        changed = 1;
+    }
+  }
+
+  return changed;
+}
+
+char reloadPoll(Reloader *reloader) {
+  char swapped = 0;
+
+  if (!reloader)
+    return 0;
+
+  if (readEvents(reloader->fd))
+    reloader->changed = 1;
+
+  pthread_mutex_lock(&reloader->mutex);
+
+  if (reloader->ready &&
+      glClientWaitSync(reloader->sync, 0, 0) != GL_TIMEOUT_EXPIRED) {
+    rendererSwapPrograms(reloader->programs, &reloader->fresh);
+    glDeleteSync(reloader->sync);
+    reloader->ready = 0;
+    swapped = 1;
+    puts("[Info] Reloaded shaders");
+  }
+
+  /* One build at a time, later edits are picked up by the next one. */
+  if (reloader->changed && !reloader->requested && !reloader->building &&
+      !reloader->ready) {
+    reloader->snapshot = *reloader->programs;
+    reloader->mask = rendererLivePrograms(reloader->programs);
+    reloader->requested = 1;
+    reloader->changed = 0;
+    pthread_cond_signal(&reloader->wake);
+  }
+
+  pthread_mutex_unlock(&reloader->mutex);
+  return swapped;
+}
@@ -0,0 +1,505 @@
+#include <wilk/arena.h>
+#include <wilk/kernel.h>
+#include <wilk/pack.h>
+#include <wilk/renderer.h>
+#include <wilk/shader.h>
+#include <wilk/zoom.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const float vertices[] = {
+    +1.0f, +1.0f, 0.0f, // top right
+    +1.0f, -1.0f, 0.0f, // bottom right
+    -1.0f, -1.0f, 0.0f, // bottom left
+    -1.0f, +1.0f, 0.0f  // top left
+};
+
+static const unsigned int indices[] = {
+    // note that we start from 0!
+    0, 1, 3, // first triangle
+    1, 2, 3  // second triangle
+};
+
+/* Builds the wilk.frag or chunk.comp program of a formula from the current
+ * sources, see formula.glsl. The custom formula of the process is
+ * appended in GLSL. */
+static GLuint buildFormula(uint32_t id, char chunk) {
+  uint32_t formula = FORMULA_INDEX(id);
+  const char *glsl, *generated = formulaGLSL(id);
+  Arena *arena = arenaThread();
+  ArenaMark mark = arenaMark(arena);
+  GLuint program = 0;
+  char *prelude;
+
+  glsl = readFile("src/shader/formula.glsl");
+  prelude = glsl ? arenaAlloc(arena, strlen(glsl) +
+                                         (generated ? strlen(generated) : 0) +
+                                         32)
+                 : NULL;
+
+  if (!prelude) {
+    fprintf(stderr, "[Error] Unable to read src/shader/formula.glsl\n");
+  } else {
+    sprintf(prelude, "#define FORMULA %u\n%s%s", formula, glsl,
+            generated ? generated : "");
+    program = chunk ? computeProgramWith("src/shader/chunk.comp", prelude)
+                    : shaderProgramWith("src/shader/wilk.vert",
+                                        "src/shader/wilk.frag", prelude);
+  }
+
+  arenaRewind(arena, mark);
+  if (program)
+    printf(" [Debug] Specialised %s for %s\n",
+           chunk ? "chunk.comp" : "wilk.frag", formulaName(formula));
+  return program;
+}
+
+/* The program of a formula, built on first use. A failed build is not
+ * retried. */
+static GLuint formulaProgram(Renderer *renderer, uint32_t id, char chunk) {
+  Programs *shared = renderer->programs;
+  GLuint *programs = chunk ? shared->chunk : shared->wilk;
+  uint32_t formula = FORMULA_INDEX(id);
+  uint32_t bit = 1u << (chunk ? FORMULA_COUNT + formula : formula);
+
+  if (formula >= FORMULA_COUNT ||
+      (formula == FORMULA_CUSTOM && !formulaGLSL(id)))
+    return 0;
+  if (shared->built & bit)
+    return programs[formula];
+
+  shared->built |= bit;
+  if (formula == FORMULA_CUSTOM)
+    shared->custom = id;
+  programs[formula] = buildFormula(id, chunk);
+  return programs[formula];
+}
+
+char rendererInit(Renderer *renderer, Renderer *share) {
+  puts(" [Debug] Creating buffers");
+  glGenBuffers(1, &renderer->vbo);
+  glGenBuffers(1, &renderer->ebo);
+  glGenVertexArrays(1, &renderer->vao);
+  glBindVertexArray(renderer->vao);
+
+  /* VBO */
+  glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+  /* Sets location of the vertex to 0 */
+  //                    POS LEN TYPE    NORMALIZE STRIDE            POINTER:
+  //                                                                Position
+  //                                                                 data
+  //                                                                begins
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_TRUE, 3 * sizeof(float), (void *)0);
+  glEnableVertexAttribArray(0);
+
+  /* EBO */
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices,
+               GL_STATIC_DRAW);
+
+  glGenFramebuffers(1, &renderer->fbo);
+  glGenTextures(1, &renderer->target);
+  renderer->width = 0;
+  renderer->height = 0;
+
+  renderer->programs = share ? share->programs
+                             : calloc(1, sizeof(*renderer->programs));
+  if (!renderer->programs) {
+    rendererDestroy(renderer);
+    return 0;
+  }
+  renderer->programs->users++;
+
+  /* The other formulas follow when a view needs them. */
+  if (!share) {
+    puts("[Info] Compiling shaders");
+    renderer->programs->colour =
+        shaderProgram("src/shader/wilk.vert", "src/shader/colour.frag");
+  }
+
+  if (!formulaProgram(renderer, FORMULA_MANDELBROT, 0) ||
+      !renderer->programs->colour) {
+    rendererDestroy(renderer);
+    return 0;
+  }
+
+  if (!GLAD_GL_VERSION_4_3 || !histogramInit(&renderer->histogram))
+    puts("[Info] No compute shaders, histogram colouring disabled");
+  if (GLAD_GL_VERSION_4_3)
+    statsInit(&renderer->stats);
+
+  glGenTextures(1, &renderer->next);
+  glGenTextures(1, &renderer->orbit);
+  glGenTextures(1, &renderer->derivative);
+  glGenTextures(1, &renderer->progress);
+  renderer->chunkIterations = RENDERER_CHUNK;
+  renderer->upscale = UPSCALE_EDGE;
+  renderer->heatmap = 0;
+  renderer->busy = 0;
+
+  renderer->chunked =
+      GLAD_GL_VERSION_4_3 && formulaProgram(renderer, FORMULA_MANDELBROT, 1);
+  if (!renderer->chunked && !share)
+    puts("[Info] Rendering every view in a single pass");
+
+  return 1;
+}
+
+void rendererDestroy(Renderer *renderer) {
+  Programs *programs = renderer->programs;
+
+  histogramDestroy(&renderer->histogram);
+  statsDestroy(&renderer->stats);
+  if (programs && !--programs->users) {
+    for (int i = 0; i < FORMULA_COUNT; i++) {
+      glDeleteProgram(programs->wilk[i]);
+      glDeleteProgram(programs->chunk[i]);
+    }
+    glDeleteProgram(programs->colour);
+    free(programs);
+  }
+  glDeleteTextures(1, &renderer->target);
+  glDeleteTextures(1, &renderer->next);
+  glDeleteTextures(1, &renderer->orbit);
+  glDeleteTextures(1, &renderer->derivative);
+  glDeleteTextures(1, &renderer->progress);
+  glDeleteFramebuffers(1, &renderer->fbo);
+  glDeleteVertexArrays(1, &renderer->vao);
+  glDeleteBuffers(1, &renderer->vbo);
+  glDeleteBuffers(1, &renderer->ebo);
+
+  renderer->programs = NULL;
+  renderer->chunked = 0;
+}
+
+uint32_t rendererLivePrograms(const Programs *programs) {
+  uint32_t mask = programs->colour ? PROGRAMS_COLOUR : 0;
+
+  for (int i = 0; i < FORMULA_COUNT; i++) {
+    mask |= programs->wilk[i] ? 1u << i : 0;
+    mask |= programs->chunk[i] ? 1u << (FORMULA_COUNT + i) : 0;
+  }
+
+  return mask;
+}
+
+char rendererBuildPrograms(const Programs *programs, uint32_t mask,
+                           Programs *fresh) {
+  memset(fresh, 0, sizeof(*fresh));
+  fresh->custom = programs->custom;
+  fresh->built = mask;
+
+  for (uint32_t i = 0; i < 2 * FORMULA_COUNT; i++) {
+    uint32_t formula = i % FORMULA_COUNT;
+    uint32_t id = formula == FORMULA_CUSTOM ? fresh->custom : formula;
+    char chunk = i >= FORMULA_COUNT;
+    GLuint *program = chunk ? &fresh->chunk[formula] : &fresh->wilk[formula];
+
+    if ((mask & 1u << i) && !(*program = buildFormula(id, chunk)))
+      goto failed;
+  }
+
+  if ((mask & PROGRAMS_COLOUR) &&
+      !(fresh->colour = shaderProgram("src/shader/wilk.vert",
+                                      "src/shader/colour.frag")))
+    goto failed;
+
+  return 1;
+
+failed:
+  for (int i = 0; i < FORMULA_COUNT; i++) {
+    glDeleteProgram(fresh->wilk[i]);
+    glDeleteProgram(fresh->chunk[i]);
+  }
+  glDeleteProgram(fresh->colour);
+  return 0;
+}
+
+void rendererSwapPrograms(Programs *programs, const Programs *fresh) {
+  for (int i = 0; i < FORMULA_COUNT; i++) {
+    if (fresh->built & 1u << i) {
+      glDeleteProgram(programs->wilk[i]);
+      programs->wilk[i] = fresh->wilk[i];
+    }
+    if (fresh->built & 1u << (FORMULA_COUNT + i)) {
+      glDeleteProgram(programs->chunk[i]);
+      programs->chunk[i] = fresh->chunk[i];
+    }
+  }
+
+  if (fresh->built & PROGRAMS_COLOUR) {
+    glDeleteProgram(programs->colour);
+    programs->colour = fresh->colour;
+  }
+}
+
+static void allocate(GLuint texture, GLenum internalFormat, GLenum format,
+                     GLenum type, GLenum filter, uint32_t width,
+                     uint32_t height) {
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format,
+               type, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+char rendererResize(Renderer *renderer, uint32_t width, uint32_t height) {
+  if (width == renderer->width && height == renderer->height)
+    return 0;
+
+  /* Sampled at an offset and scale while zooming. */
+  allocate(renderer->target, GL_R32F, GL_RED, GL_FLOAT, GL_LINEAR, width,
+           height);
+  glBindFramebuffer(GL_FRAMEBUFFER, renderer->fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         renderer->target, 0);
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  if (renderer->chunked) {
+    allocate(renderer->next, GL_R32F, GL_RED, GL_FLOAT, GL_LINEAR, width,
+             height);
+    allocate(renderer->orbit, GL_RGBA32UI, GL_RGBA_INTEGER, GL_UNSIGNED_INT,
+             GL_NEAREST, width, height);
+    allocate(renderer->progress, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT,
+             GL_NEAREST, width, height);
+    /* Only distance estimation needs it, allocated on first use. */
+    renderer->hasDerivative = 0;
+  }
+
+  renderer->busy = 0;
+  renderer->width = width;
+  renderer->height = height;
+  renderer->detail.width = 0;
+  renderer->detail.height = 0;
+  return 1;
+}
+
+char rendererUpload(Renderer *renderer, TileStore *store, const View *view) {
+  size_t count = (size_t)renderer->width * renderer->height;
+  Arena *arena = arenaThread();
+  ArenaMark mark = arenaMark(arena);
+  TileKey key;
+  Tile tile;
+  float *data;
+  char ok;
+
+  viewTileKey(view, renderer->width, renderer->height, TILE_FORMAT_PACKED,
+              &key);
+  if (!store || !tileStoreGet(store, &key, &tile))
+    return 0;
+
+  data = arenaAlloc(arena, count * sizeof(*data));
+  ok = data && packDecode(&key, tile.data, tile.size, data);
+  tileStoreRelease(&tile);
+
+  if (!ok) {
+    arenaRewind(arena, mark);
+    return 0;
+  }
+
+  /* Whatever was still being rendered is out of date now. */
+  renderer->busy = 0;
+  rendererFullDetail(renderer, view, &renderer->detail);
+
+  glBindTexture(GL_TEXTURE_2D, renderer->target);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, renderer->width, renderer->height,
+                  GL_RED, GL_FLOAT, data);
+  arenaRewind(arena, mark);
+  return 1;
+}
+
+void rendererFullDetail(const Renderer *renderer, const View *view,
+                        Detail *detail) {
+  detail->width = renderer->width;
+  detail->height = renderer->height;
+  detail->maxIterations = view->maxIterations;
+}
+
+/* Uniforms wilk.frag and chunk.comp share. */
+static void viewUniforms(GLuint program, const View *view,
+                         const Detail *detail) {
+  glUniform2d(glGetUniformLocation(program, "limits"), detail->width,
+              detail->height);
+  glUniform2d(glGetUniformLocation(program, "loc"), view->x, view->y);
+  glUniform1d(glGetUniformLocation(program, "scale"), view->scale);
+  glUniform1d(glGetUniformLocation(program, "maxIterations"),
+              detail->maxIterations);
+  glUniform1i(glGetUniformLocation(program, "kernel"), view->kernel);
+  glUniform1i(glGetUniformLocation(program, "julia"), view->julia != 0);
+  glUniform2d(glGetUniformLocation(program, "juliaC"), view->cx, view->cy);
+}
+
+/* The whole view in one draw, for contexts without compute shaders. */
+static void renderOnce(Renderer *renderer, const View *view,
+                       const Detail *detail) {
+  GLuint program = formulaProgram(renderer, view->formula, 0);
+
+  if (!program)
+    return;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, renderer->fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         renderer->target, 0);
+  glViewport(0, 0, detail->width, detail->height);
+  glBindVertexArray(renderer->vao);
+  glUseProgram(program);
+  viewUniforms(program, view, detail);
+
+  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+}
+
+void rendererIterate(Renderer *renderer, const View *view) {
+  rendererBegin(renderer, view, NULL);
+
+  /* Separate submissions, each one short enough for the watchdog. */
+  while (!rendererContinue(renderer))
+    glFlush();
+}
+
+void rendererBegin(Renderer *renderer, const View *view,
+                   const Detail *detail) {
+  Detail *pending = &renderer->pendingDetail;
+
+  renderer->pending = *view;
+  renderer->chunk = 0;
+  renderer->chunks = 0;
+  renderer->busy = 1;
+
+  rendererFullDetail(renderer, view, pending);
+  if (detail) {
+    pending->width = detail->width < pending->width ? detail->width
+                                                    : pending->width;
+    pending->height = detail->height < pending->height ? detail->height
+                                                       : pending->height;
+    pending->maxIterations = fmin(detail->maxIterations, view->maxIterations);
+  }
+
+  if (!renderer->chunked || !renderer->chunkIterations ||
+      !formulaProgram(renderer, view->formula, 1)) {
+    renderOnce(renderer, view, pending);
+    return;
+  }
+
+  renderer->chunks =
+      (uint32_t)ceil(pending->maxIterations / renderer->chunkIterations);
+  if (!renderer->chunks)
+    renderer->chunks = 1;
+
+  if (view->kernel == KERNEL_DISTANCE && !renderer->hasDerivative) {
+    allocate(renderer->derivative, GL_RGBA32UI, GL_RGBA_INTEGER,
+             GL_UNSIGNED_INT, GL_NEAREST, renderer->width, renderer->height);
+    renderer->hasDerivative = 1;
+  }
+}
+
+char rendererContinue(Renderer *renderer) {
+  const View *view = &renderer->pending;
+  GLuint program = renderer->programs->chunk[FORMULA_INDEX(view->formula)],
+         swap;
+  const Detail *detail = &renderer->pendingDetail;
+
+  if (!renderer->busy)
+    return 0;
+
+  if (renderer->chunk < renderer->chunks) {
+    glUseProgram(program);
+    viewUniforms(program, view, detail);
+    glUniform1ui(glGetUniformLocation(program, "chunk"),
+                 renderer->chunkIterations);
+    glUniform1i(glGetUniformLocation(program, "first"), renderer->chunk == 0);
+
+    glBindImageTexture(0, renderer->orbit, 0, GL_FALSE, 0, GL_READ_WRITE,
+                       GL_RGBA32UI);
+    glBindImageTexture(1, renderer->hasDerivative ? renderer->derivative : 0,
+                       0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32UI);
+    glBindImageTexture(2, renderer->progress, 0, GL_FALSE, 0, GL_READ_WRITE,
+                       GL_R32UI);
+    glBindImageTexture(3, renderer->next, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+                       GL_R32F);
+
+    glDispatchCompute((detail->width + 15) / 16, (detail->height + 15) / 16,
+                      1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    if (++renderer->chunk < renderer->chunks)
+      return 0;
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT |
+                    GL_TEXTURE_UPDATE_BARRIER_BIT);
+    swap = renderer->target;
+    renderer->target = renderer->next;
+    renderer->next = swap;
+  }
+
+  renderer->detail = *detail;
+  renderer->busy = 0;
+  return 1;
+}
+
+void rendererEqualize(Renderer *renderer, const View *rendered) {
+  const Detail *detail = &renderer->detail;
+
+  if (renderer->histogram.cdf && rendered->kernel == KERNEL_ESCAPE_TIME)
+    histogramUpdate(&renderer->histogram, renderer->target, detail->width,
+                    detail->height, detail->maxIterations);
+}
+
+char rendererMeasure(Renderer *renderer, const View *rendered) {
+  const Detail *detail = &renderer->detail;
+
+  /* Distance renders hold no iteration counts. */
+  return rendered->kernel == KERNEL_ESCAPE_TIME &&
+         statsMeasure(&renderer->stats, renderer->target, detail->width,
+                      detail->height, detail->maxIterations);
+}
+
+void rendererColour(Renderer *renderer, const View *rendered,
+                    const View *shown, uint32_t width, uint32_t height,
+                    char equalize) {
+  rendererColourFrom(renderer, renderer, rendered, shown, width, height,
+                     equalize);
+}
+
+void rendererColourFrom(Renderer *renderer, const Renderer *source,
+                        const View *rendered, const View *shown,
+                        uint32_t width, uint32_t height, char equalize) {
+  GLuint program = renderer->programs->colour;
+  float transform[3];
+
+  zoomTransform(rendered, shown, transform);
+
+  glViewport(0, 0, width, height);
+  glBindVertexArray(renderer->vao);
+  glUseProgram(program);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, source->target);
+  glUniform1i(glGetUniformLocation(program, "iterations"), 0);
+  glUniform1f(glGetUniformLocation(program, "maxIterations"),
+              source->detail.maxIterations);
+  glUniform2f(glGetUniformLocation(program, "resolution"), width, height);
+  glUniform3fv(glGetUniformLocation(program, "rescale"), 1, transform);
+  glUniform2f(glGetUniformLocation(program, "extent"),
+              (float)source->detail.width / source->width,
+              (float)source->detail.height / source->height);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_1D, source->histogram.cdf);
+  glUniform1i(glGetUniformLocation(program, "cdf"), 1);
+  glUniform1i(glGetUniformLocation(program, "equalize"),
+              equalize && source->histogram.cdf);
+  /* The target holds what the rendered view's kernel wrote, shown may have
+   * switched already while the next render is pending. */
+  glUniform1i(glGetUniformLocation(program, "kernel"), rendered->kernel);
+  glUniform1i(glGetUniformLocation(program, "upscale"), renderer->upscale);
+  glUniform1i(glGetUniformLocation(program, "heatmap"), renderer->heatmap);
+
+  glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+}
@@ -0,0 +1,152 @@
+#include <wilk/arena.h>
+#include <wilk/shader.h>
+
+#include <stdio.h>
+#include <string.h>
+
+const char *readFile(const char *path) {
+  long size;
+  char *buffer;
+  FILE *fp;
+
+  fp = fopen(path, "r");
+  if (!fp)
+    return NULL;
+
+  fseek(fp, 0L, SEEK_END);
+  size = ftell(fp);
+  fseek(fp, 0L, SEEK_SET);
+
+  buffer = size < 0 ? NULL : arenaAlloc(arenaThread(), size + 1);
+  if (buffer) {
+    size = fread(buffer, sizeof(char), size, fp);
+    buffer[size] = '\0';
+  }
+
+  fclose(fp);
+  return buffer;
+}
+
+char checkLinkError(GLuint idx) {
+  char log[1024];
+  GLint ok;
+
+  glGetProgramiv(idx, GL_LINK_STATUS, &ok);
+
+  if (!ok) {
+    glGetProgramInfoLog(idx, 1024, NULL, log);
+    printf("Shader link failed with error: %s\n", log);
+    return 0;
+  }
+
+  return 1;
+}
+
+char checkShaderCompileError(GLuint idx) {
+  char log[1024];
+  GLint compiled;
+
+  glGetShaderiv(idx, GL_COMPILE_STATUS, &compiled);
+
+  if (!compiled) {
+    glGetShaderInfoLog(idx, 1024, NULL, log);
+    printf("Shader compile failed with error: %s\n", log);
+    glDeleteShader(idx);
+    return 0;
+  }
+
+  return 1;
+}
+
+static GLuint compileShader(GLenum type, const char *path,
+                            const char *prelude) {
+  ArenaMark mark = arenaMark(arenaThread());
+  const char *source = readFile(path), *sources[4], *body;
+  GLint lengths[4] = {-1, -1, -1, -1};
+  GLsizei count = 1;
+  GLuint shader;
+
+  if (!source) {
+    fprintf(stderr, "[Error] Unable to read %s\n", path);
+    return 0;
+  }
+
+  /* Errors still point at the right lines of the file. */
+  sources[0] = source;
+  if (prelude && (body = strchr(source, '\n'))) {
+    lengths[0] = body + 1 - source;
+    sources[1] = prelude;
+    sources[2] = "\n#line 2\n";
+    sources[3] = body + 1;
+    count = 4;
+  }
+
+  shader = glCreateShader(type);
+  glShaderSource(shader, count, sources, lengths);
+  glCompileShader(shader);
+  arenaRewind(arenaThread(), mark);
+
+  if (!checkShaderCompileError(shader))
+    return 0;
+
+  printf(" [Debug] Compiled %s\n", path);
+  return shader;
+}
+
+GLuint shaderProgram(const char *vertexPath, const char *fragmentPath) {
+  return shaderProgramWith(vertexPath, fragmentPath, NULL);
+}
+
+GLuint shaderProgramWith(const char *vertexPath, const char *fragmentPath,
+                         const char *prelude) {
+  GLuint vertexShader, fragmentShader, program;
+
+  vertexShader = compileShader(GL_VERTEX_SHADER, vertexPath, NULL);
+  if (!vertexShader)
+    return 0;
+
+  fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentPath, prelude);
+  if (!fragmentShader) {
+    glDeleteShader(vertexShader);
+    return 0;
+  }
+
+  program = glCreateProgram();
+  glAttachShader(program, vertexShader);
+  glAttachShader(program, fragmentShader);
+  glLinkProgram(program);
+
+  glDeleteShader(vertexShader);
+  glDeleteShader(fragmentShader);
+
+  if (!checkLinkError(program)) {
+    glDeleteProgram(program);
+    return 0;
+  }
+
+  return program;
+}
+
+GLuint computeProgram(const char *path) {
+  return computeProgramWith(path, NULL);
+}
+
+GLuint computeProgramWith(const char *path, const char *prelude) {
+  GLuint shader, program;
+
+  shader = compileShader(GL_COMPUTE_SHADER, path, prelude);
+  if (!shader)
+    return 0;
+
+  program = glCreateProgram();
+  glAttachShader(program, shader);
+  glLinkProgram(program);
+  glDeleteShader(shader);
+
+  if (!checkLinkError(program)) {
+    glDeleteProgram(program);
+    return 0;
+  }
+
+  return program;
+}
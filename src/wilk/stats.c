@@ -0,0 +1,98 @@
+#include <wilk/shader.h>
+#include <wilk/stats.h>
+
+#include <string.h>
+
+/* Words of the Totals block in stats.comp. */
+enum { TOTAL_LOW, TOTAL_HIGH, TOTAL_ESCAPED, TOTAL_CAPPED, TOTAL_MAX, TOTALS };
+
+char statsInit(Stats *stats) {
+  stats->program = computeProgram("src/shader/stats.comp");
+  if (!stats->program) {
+    statsDestroy(stats);
+    return 0;
+  }
+
+  glGenBuffers(1, &stats->totals);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, stats->totals);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, TOTALS * sizeof(GLuint), NULL,
+               GL_DYNAMIC_COPY);
+
+  glGenBuffers(1, &stats->copy);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, stats->copy);
+  glBufferData(GL_COPY_WRITE_BUFFER, TOTALS * sizeof(GLuint), NULL,
+               GL_STREAM_READ);
+  return 1;
+}
+
+void statsDestroy(Stats *stats) {
+  glDeleteProgram(stats->program);
+  glDeleteBuffers(1, &stats->totals);
+  glDeleteBuffers(1, &stats->copy);
+  if (stats->fence)
+    glDeleteSync(stats->fence);
+
+  stats->program = 0;
+  stats->totals = 0;
+  stats->copy = 0;
+  stats->fence = NULL;
+}
+
+char statsMeasure(Stats *stats, GLuint iterations, GLuint width,
+                  GLuint height, double maxIterations) {
+  GLuint zero = 0;
+
+  if (!stats->program || stats->fence)
+    return 0;
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, stats->totals);
+  glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER,
+                    GL_UNSIGNED_INT, &zero);
+
+  glUseProgram(stats->program);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, iterations);
+  glUniform1i(glGetUniformLocation(stats->program, "iterations"), 0);
+  glUniform1f(glGetUniformLocation(stats->program, "maxIterations"),
+              maxIterations);
+  glUniform2i(glGetUniformLocation(stats->program, "size"), width, height);
+  glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+  glBindBuffer(GL_COPY_READ_BUFFER, stats->totals);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, stats->copy);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                      TOTALS * sizeof(GLuint));
+  stats->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  return 1;
+}
+
+char statsCollect(Stats *stats, IterationStats *out) {
+  const GLuint *totals;
+  uint32_t pixels;
+
+  if (!stats->fence ||
+      glClientWaitSync(stats->fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    return 0;
+
+  glDeleteSync(stats->fence);
+  stats->fence = NULL;
+
+  glBindBuffer(GL_COPY_READ_BUFFER, stats->copy);
+  totals = glMapBufferRange(GL_COPY_READ_BUFFER, 0, TOTALS * sizeof(GLuint),
+                            GL_MAP_READ_BIT);
+  if (!totals)
+    return 0;
+
+  memset(out, 0, sizeof(*out));
+  out->iterations =
+      (uint64_t)totals[TOTAL_HIGH] << 32 | totals[TOTAL_LOW];
+  out->escaped = totals[TOTAL_ESCAPED];
+  out->capped = totals[TOTAL_CAPPED];
+  out->max = totals[TOTAL_MAX];
+  glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+  pixels = out->escaped + out->capped;
+  out->mean = pixels ? (double)out->iterations / pixels : 0.0;
+  return 1;
+}
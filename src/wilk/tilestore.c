@@ -0,0 +1,650 @@
+#define _GNU_SOURCE
+#include <wilk/tilestore.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INDEX_MAGIC "WILKIDX"
+#define TILE_MAGIC "WILKTIL"
+#define STORE_VERSION 3
+
+/* Data starts at a fixed offset so it stays aligned inside the mapping. */
+#define TILE_HEADER_SIZE 128
+/* Eviction makes room for this much more than it has to, so it runs once
+ * in a while and not on every put of a full store. */
+#define EVICT_SLACK 0.25
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t entrySize;
+  uint64_t reserved[2];
+} IndexHeader;
+
+/* Entries are appended, an entry whose hash does not match its key is
+ * still being written or was torn by a crash and does not count. */
+typedef struct {
+  uint64_t hash;
+  uint64_t size; /* bytes of tile data */
+  TileKey key;
+} IndexEntry;
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t dataSize;
+  TileKey key;
+} TileHeader;
+
+_Static_assert(sizeof(TileKey) == 80, "TileKey must not contain padding");
+_Static_assert(sizeof(IndexHeader) == 32, "unexpected index header size");
+_Static_assert(sizeof(IndexEntry) == 96, "unexpected index entry size");
+_Static_assert(sizeof(TileHeader) <= TILE_HEADER_SIZE, "tile header too big");
+
+struct TileStore {
+  char path[PATH_MAX];
+  int lockFd;
+  pthread_mutex_t mutex;
+  uint64_t capacity;
+
+  /* Current read-only mapping of the index file. */
+  void *index;
+  size_t indexSize;
+  ino_t indexInode;
+  unsigned int tmpCounter;
+
+  /* Open addressing table of entry number + 1 by hash, over the first
+   * indexed entries of the mapping. */
+  uint32_t *slots;
+  size_t slotCount, indexed, live;
+  uint64_t bytes; /* on disk for the live entries */
+};
+
+static uint64_t hashKey(const TileKey *key) {
+  const unsigned char *p = (const unsigned char *)key;
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < sizeof(*key); i++) {
+    hash ^= p[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+static char keyEquals(const TileKey *a, const TileKey *b) {
+  return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+size_t tileFormatSize(uint32_t format) {
+  switch (format) {
+  case TILE_FORMAT_U32:
+    return sizeof(uint32_t);
+  case TILE_FORMAT_F32:
+    return sizeof(float);
+  }
+
+  return 0;
+}
+
+static size_t tileDataSize(const TileKey *key) {
+  return (size_t)key->width * key->height * tileFormatSize(key->format);
+}
+
+static char writeAll(int fd, const void *buffer, size_t size) {
+  const char *p = buffer;
+
+  while (size) {
+    ssize_t written = write(fd, p, size);
+
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return 0;
+    }
+
+    p += written;
+    size -= written;
+  }
+
+  return 1;
+}
+
+/* Writes head and body to a temporary file next to path and renames it into
+ * place once it is safely on disk. */
+static char replaceFile(TileStore *store, const char *path, const void *head,
+                        size_t headSize, const void *body, size_t bodySize) {
+  char tmp[PATH_MAX + 64];
+  int fd;
+
+  snprintf(tmp, sizeof(tmp), "%s.%d.%u.tmp", path, (int)getpid(),
+           __atomic_fetch_add(&store->tmpCounter, 1, __ATOMIC_RELAXED));
+
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return 0;
+
+  if (!writeAll(fd, head, headSize) || !writeAll(fd, body, bodySize) ||
+      fsync(fd) != 0) {
+    close(fd);
+    unlink(tmp);
+    return 0;
+  }
+
+  close(fd);
+
+  if (rename(tmp, path) != 0) {
+    unlink(tmp);
+    return 0;
+  }
+
+  return 1;
+}
+
+static void syncDirectory(const char *path) {
+  int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+static const IndexEntry *indexEntries(TileStore *store) {
+  return (const IndexEntry *)((const char *)store->index + sizeof(IndexHeader));
+}
+
+/* Complete entries in the mapping, the last one may still be written. */
+static size_t indexEntryCount(TileStore *store) {
+  return store->index
+             ? (store->indexSize - sizeof(IndexHeader)) / sizeof(IndexEntry)
+             : 0;
+}
+
+static char validEntry(const IndexEntry *entry) {
+  return entry->hash == hashKey(&entry->key);
+}
+
+static void indexHeaderInit(IndexHeader *header) {
+  memset(header, 0, sizeof(*header));
+  memcpy(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  header->version = STORE_VERSION;
+  header->entrySize = sizeof(IndexEntry);
+}
+
+static char validIndexHeader(const IndexHeader *header) {
+  return memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+         header->version == STORE_VERSION &&
+         header->entrySize == sizeof(IndexEntry);
+}
+
+/* Entry number of key or -1. Caller holds mutex. */
+static long tableFind(TileStore *store, uint64_t hash, const TileKey *key) {
+  const IndexEntry *entries = indexEntries(store);
+  size_t mask = store->slotCount - 1;
+
+  if (!store->slotCount)
+    return -1;
+
+  for (size_t i = hash & mask; store->slots[i]; i = (i + 1) & mask) {
+    const IndexEntry *entry = &entries[store->slots[i] - 1];
+
+    if (entry->hash == hash && keyEquals(&entry->key, key))
+      return store->slots[i] - 1;
+  }
+
+  return -1;
+}
+
+/* Whether no entry from first to count is valid. */
+static char invalidTail(const IndexEntry *entries, size_t first, size_t count) {
+  for (size_t i = first; i < count; i++)
+    if (validEntry(&entries[i]))
+      return 0;
+
+  return 1;
+}
+
+/* Adds the entries of the mapping that are not in the table yet. */
+static void tableUpdate(TileStore *store) {
+  const IndexEntry *entries = indexEntries(store);
+  size_t count = indexEntryCount(store);
+
+  /* Half full at most, rebuilt from scratch when it grows. */
+  if (2 * count > store->slotCount) {
+    size_t slotCount = store->slotCount ? store->slotCount : 1024;
+    uint32_t *slots;
+
+    while (2 * count > slotCount)
+      slotCount *= 2;
+
+    slots = calloc(slotCount, sizeof(*slots));
+    if (!slots)
+      return;
+
+    free(store->slots);
+    store->slots = slots;
+    store->slotCount = slotCount;
+    store->indexed = store->live = 0;
+    store->bytes = 0;
+  }
+
+  for (; store->indexed < count; store->indexed++) {
+    const IndexEntry *entry = &entries[store->indexed];
+    size_t mask = store->slotCount - 1, i;
+
+    /* Entries at the tail may still be written, look at them again next
+     * time. One with valid entries after it is garbage for good. */
+    if (!validEntry(entry)) {
+      if (invalidTail(entries, store->indexed, count))
+        break;
+      continue;
+    }
+
+    if (tableFind(store, entry->hash, &entry->key) >= 0)
+      continue;
+
+    for (i = entry->hash & mask; store->slots[i]; i = (i + 1) & mask)
+      ;
+
+    store->slots[i] = store->indexed + 1;
+    store->live++;
+    store->bytes += TILE_HEADER_SIZE + entry->size;
+  }
+}
+
+static void tableClear(TileStore *store) {
+  if (store->slots)
+    memset(store->slots, 0, store->slotCount * sizeof(*store->slots));
+  store->indexed = store->live = 0;
+  store->bytes = 0;
+}
+
+/* Maps the index again if another writer replaced or appended to it.
+ * Caller holds mutex. */
+static void refreshIndex(TileStore *store) {
+  char path[PATH_MAX + 16];
+  struct stat st;
+  char replaced;
+  void *map;
+  int fd;
+
+  snprintf(path, sizeof(path), "%s/index", store->path);
+
+  if (stat(path, &st) != 0)
+    return;
+
+  replaced = !store->index || st.st_ino != store->indexInode;
+  if (!replaced && (size_t)st.st_size == store->indexSize)
+    return;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexHeader)) {
+    close(fd);
+    return;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED)
+    return;
+
+  if (!validIndexHeader(map)) {
+    fprintf(stderr, "[Error] Ignoring invalid tile index %s\n", path);
+    munmap(map, st.st_size);
+    return;
+  }
+
+  if (store->index)
+    munmap(store->index, store->indexSize);
+
+  store->index = map;
+  store->indexSize = st.st_size;
+  store->indexInode = st.st_ino;
+
+  if (replaced)
+    tableClear(store);
+  tableUpdate(store);
+}
+
+static void tilePath(TileStore *store, uint64_t hash, char *path,
+                     size_t size) {
+  snprintf(path, size, "%s/tiles/%016llx.tile", store->path,
+           (unsigned long long)hash);
+}
+
+TileStore *tileStoreOpen(const char *path, uint64_t capacity) {
+  char buffer[PATH_MAX + 16];
+  TileStore *store;
+
+  if (strlen(path) >= PATH_MAX)
+    return NULL;
+
+  snprintf(buffer, sizeof(buffer), "%s/tiles", path);
+  if ((mkdir(path, 0755) != 0 && errno != EEXIST) ||
+      (mkdir(buffer, 0755) != 0 && errno != EEXIST)) {
+    fprintf(stderr, "[Error] Unable to create tile store %s: %s\n", path,
+            strerror(errno));
+    return NULL;
+  }
+
+  store = calloc(1, sizeof(*store));
+  if (!store)
+    return NULL;
+
+  strcpy(store->path, path);
+  store->capacity = capacity;
+  pthread_mutex_init(&store->mutex, NULL);
+
+  snprintf(buffer, sizeof(buffer), "%s/lock", path);
+  store->lockFd = open(buffer, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (store->lockFd < 0) {
+    fprintf(stderr, "[Error] Unable to open %s: %s\n", buffer,
+            strerror(errno));
+    pthread_mutex_destroy(&store->mutex);
+    free(store);
+    return NULL;
+  }
+
+  refreshIndex(store);
+  return store;
+}
+
+void tileStoreClose(TileStore *store) {
+  if (!store)
+    return;
+
+  if (store->index)
+    munmap(store->index, store->indexSize);
+
+  close(store->lockFd);
+  pthread_mutex_destroy(&store->mutex);
+  free(store->slots);
+  free(store);
+}
+
+size_t tileStoreCount(TileStore *store) {
+  size_t count = 0;
+
+  pthread_mutex_lock(&store->mutex);
+  refreshIndex(store);
+  count = store->live;
+  pthread_mutex_unlock(&store->mutex);
+
+  return count;
+}
+
+char tileStoreGet(TileStore *store, const TileKey *key, Tile *tile) {
+  char path[PATH_MAX + 64];
+  const TileHeader *header;
+  uint64_t hash = hashKey(key);
+  size_t dataSize = tileDataSize(key);
+  struct stat st;
+  char found;
+  void *map;
+  int fd;
+
+  if (!dataSize && key->format != TILE_FORMAT_PACKED)
+    return 0;
+
+  pthread_mutex_lock(&store->mutex);
+  refreshIndex(store);
+  found = tableFind(store, hash, key) >= 0;
+  pthread_mutex_unlock(&store->mutex);
+
+  if (!found)
+    return 0;
+
+  tilePath(store, hash, path, sizeof(path));
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return 0;
+
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size <= TILE_HEADER_SIZE ||
+      (dataSize && (size_t)st.st_size != TILE_HEADER_SIZE + dataSize)) {
+    close(fd);
+    return 0;
+  }
+
+  /* Packed tiles are as big as their file says. */
+  dataSize = st.st_size - TILE_HEADER_SIZE;
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED)
+    return 0;
+
+  header = map;
+  if (memcmp(header->magic, TILE_MAGIC, sizeof(TILE_MAGIC)) != 0 ||
+      header->version != STORE_VERSION ||
+      header->headerSize != TILE_HEADER_SIZE ||
+      header->dataSize != dataSize || !keyEquals(&header->key, key)) {
+    munmap(map, st.st_size);
+    return 0;
+  }
+
+  tile->key = *key;
+  tile->data = (const char *)map + TILE_HEADER_SIZE;
+  tile->size = dataSize;
+  tile->map = map;
+  tile->mapSize = st.st_size;
+  return 1;
+}
+
+void tileStoreRelease(Tile *tile) {
+  if (tile->map)
+    munmap(tile->map, tile->mapSize);
+
+  tile->map = NULL;
+  tile->data = NULL;
+}
+
+/* Removes the tile files of a store whose index is of another version or
+ * broken, except the one of keep. Caller holds the lock. */
+static void clearTiles(TileStore *store, uint64_t keep) {
+  char path[PATH_MAX + 16], name[32];
+  struct dirent *entry;
+  DIR *dir;
+
+  snprintf(path, sizeof(path), "%s/tiles", store->path);
+  dir = opendir(path);
+  if (!dir)
+    return;
+
+  /* Temporary files of puts in flight end in .tmp and stay. */
+  snprintf(name, sizeof(name), "%016llx.tile", (unsigned long long)keep);
+  while ((entry = readdir(dir))) {
+    size_t length = strlen(entry->d_name);
+
+    if (length == strlen(name) &&
+        strcmp(entry->d_name + length - 5, ".tile") == 0 &&
+        strcmp(entry->d_name, name) != 0)
+      unlinkat(dirfd(dir), entry->d_name, 0);
+  }
+
+  closedir(dir);
+}
+
+/* Opens the index for appending, starting a new one if there is none or it
+ * is unusable. Caller holds the lock. Returns -1 on failure. */
+static int openIndex(TileStore *store, uint64_t keep) {
+  char path[PATH_MAX + 16];
+  IndexHeader header;
+  struct stat st;
+  int fd;
+
+  snprintf(path, sizeof(path), "%s/index", store->path);
+
+  fd = open(path, O_RDWR | O_APPEND | O_CLOEXEC);
+  if (fd >= 0 && pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+      validIndexHeader(&header) && fstat(fd, &st) == 0) {
+    /* Drop what a crashed writer left of its entry, readers never look at
+     * incomplete entries. */
+    size_t whole = (st.st_size - sizeof(header)) / sizeof(IndexEntry);
+
+    if (ftruncate(fd, sizeof(header) + whole * sizeof(IndexEntry)) == 0)
+      return fd;
+
+    close(fd);
+    return -1;
+  }
+
+  /* A new store has no tiles to lose track of. */
+  if (fd >= 0) {
+    close(fd);
+    clearTiles(store, keep);
+  } else if (errno != ENOENT) {
+    return -1;
+  }
+
+  indexHeaderInit(&header);
+  if (!replaceFile(store, path, &header, sizeof(header), NULL, 0))
+    return -1;
+
+  syncDirectory(store->path);
+  return open(path, O_RDWR | O_APPEND | O_CLOEXEC);
+}
+
+/* Drops the oldest tiles until the store is EVICT_SLACK below its
+ * capacity. Caller holds the lock and has refreshed the index. */
+static void evict(TileStore *store) {
+  const IndexEntry *entries = indexEntries(store);
+  size_t count = indexEntryCount(store), first = count, kept = 0;
+  uint64_t bytes = 0, budget = store->capacity * (1.0 - EVICT_SLACK);
+  char path[PATH_MAX + 64];
+  IndexHeader header;
+  IndexEntry *keep;
+
+  /* The newest entries that fit. */
+  while (first > 0) {
+    const IndexEntry *entry = &entries[first - 1];
+
+    if (validEntry(entry)) {
+      if (bytes + TILE_HEADER_SIZE + entry->size > budget)
+        break;
+      bytes += TILE_HEADER_SIZE + entry->size;
+    }
+    first--;
+  }
+
+  keep = malloc((count - first) * sizeof(*keep) + 1);
+  if (!keep)
+    return;
+
+  for (size_t i = first; i < count; i++)
+    if (validEntry(&entries[i]))
+      keep[kept++] = entries[i];
+
+  indexHeaderInit(&header);
+  snprintf(path, sizeof(path), "%s/index", store->path);
+  if (!replaceFile(store, path, &header, sizeof(header), keep,
+                   kept * sizeof(*keep))) {
+    fprintf(stderr, "[Error] Unable to update tile index: %s\n",
+            strerror(errno));
+    free(keep);
+    return;
+  }
+  syncDirectory(store->path);
+  free(keep);
+
+  /* Readers holding one of them mapped keep it until they let go. */
+  for (size_t i = 0; i < first; i++)
+    if (validEntry(&entries[i])) {
+      tilePath(store, entries[i].hash, path, sizeof(path));
+      unlink(path);
+    }
+
+  printf("[Info] Tile store: evicted %zu old tiles\n", first);
+  refreshIndex(store);
+}
+
+char tileStorePut(TileStore *store, const TileKey *key, const void *data,
+                  size_t size) {
+  char path[PATH_MAX + 64];
+  unsigned char head[TILE_HEADER_SIZE] = {0};
+  TileHeader *header = (TileHeader *)head;
+  uint64_t hash = hashKey(key);
+  size_t dataSize = tileDataSize(key);
+  IndexEntry entry;
+  struct stat st;
+  char ok = 1;
+  int fd;
+
+  if (key->format == TILE_FORMAT_PACKED)
+    dataSize = size;
+
+  if (!size || size != dataSize)
+    return 0;
+
+  /* The tile goes first, the index never points at a missing file. */
+  memcpy(header->magic, TILE_MAGIC, sizeof(TILE_MAGIC));
+  header->version = STORE_VERSION;
+  header->headerSize = TILE_HEADER_SIZE;
+  header->dataSize = dataSize;
+  header->key = *key;
+
+  tilePath(store, hash, path, sizeof(path));
+  if (!replaceFile(store, path, head, sizeof(head), data, dataSize)) {
+    fprintf(stderr, "[Error] Unable to write tile %s: %s\n", path,
+            strerror(errno));
+    return 0;
+  }
+
+  snprintf(path, sizeof(path), "%s/tiles", store->path);
+  syncDirectory(path);
+
+  /* Serialise index updates between processes, readers never take it. */
+  pthread_mutex_lock(&store->mutex);
+  flock(store->lockFd, LOCK_EX);
+  refreshIndex(store);
+
+  if (store->index && tableFind(store, hash, key) >= 0)
+    goto out;
+
+  /* Evicted by another process while we waited for the lock. */
+  tilePath(store, hash, path, sizeof(path));
+  fd = stat(path, &st) == 0 ? openIndex(store, hash) : -1;
+  if (fd < 0) {
+    ok = 0;
+    goto out;
+  }
+
+  memset(&entry, 0, sizeof(entry));
+  entry.hash = hash;
+  entry.size = dataSize;
+  entry.key = *key;
+
+  ok = writeAll(fd, &entry, sizeof(entry)) && fdatasync(fd) == 0;
+  close(fd);
+
+  if (!ok) {
+    fprintf(stderr, "[Error] Unable to update tile index: %s\n",
+            strerror(errno));
+    goto out;
+  }
+
+  refreshIndex(store);
+  if (store->capacity && store->bytes > store->capacity)
+    evict(store);
+
+out:
+  flock(store->lockFd, LOCK_UN);
+  pthread_mutex_unlock(&store->mutex);
+  return ok;
+}
@@ -0,0 +1,61 @@
+#include <wilk/kernel.h>
+#include <wilk/view.h>
+
+#include <math.h>
+#include <string.h>
+
+static const double speed = 0.10;
+
+void viewApply(View *view, const Motion *motion) {
+  /* Keep the arithmetic identical for every caller, predicted views are
+   * looked up by exact key. */
+  if (motion->panX)
+    view->x += motion->panX * speed / view->scale;
+  if (motion->panY)
+    view->y += motion->panY * speed / view->scale;
+
+  if (motion->zoom) {
+    double px = view->x + motion->pivotX * 2.0 / view->scale;
+    double py = view->y + motion->pivotY * 2.0 / view->scale;
+
+    view->scale *= exp2(motion->zoom);
+    view->x = px - motion->pivotX * 2.0 / view->scale;
+    view->y = py - motion->pivotY * 2.0 / view->scale;
+  }
+
+  view->maxIterations += motion->iterations;
+}
+
+char viewEquals(const View *a, const View *b) {
+  return a->x == b->x && a->y == b->y && a->scale == b->scale &&
+         a->maxIterations == b->maxIterations && a->kernel == b->kernel &&
+         viewSameSet(a, b);
+}
+
+char viewSameSet(const View *a, const View *b) {
+  return a->formula == b->formula && a->julia == b->julia &&
+         (!a->julia || (a->cx == b->cx && a->cy == b->cy));
+}
+
+void viewTileKey(const View *view, uint32_t width, uint32_t height,
+                 uint32_t format, TileKey *key) {
+  memset(key, 0, sizeof(*key));
+
+  key->dx = 4.0 / (width * view->scale);
+  key->dy = 4.0 / (height * view->scale);
+  /* Pixel centres, gl_FragCoord of pixel (0, 0) is (0.5, 0.5). */
+  key->x = view->x + (0.5 - width / 2.0) * key->dx;
+  key->y = view->y + (0.5 - height / 2.0) * key->dy;
+  key->maxIterations = view->maxIterations;
+  key->width = width;
+  key->height = height;
+  key->format = format;
+  key->kernel = view->kernel;
+  key->formula = view->formula;
+  /* c does not matter for the Mandelbrot set, keep those keys equal. */
+  if (view->julia) {
+    key->julia = 1;
+    key->cx = view->cx;
+    key->cy = view->cy;
+  }
+}
@@ -0,0 +1,89 @@
+#include <wilk/zoom.h>
+
+#include <math.h>
+
+/* Time constant of the animation in seconds. */
+#define ZOOM_TIME 0.12
+/* Rendered texture may be stretched this much before it looks blurry. */
+#define ZOOM_MAX_MAGNIFICATION 1.5
+/* Part of the screen the rendered texture may leave uncovered. */
+#define ZOOM_MAX_UNCOVERED 0.04
+
+/* Screen coordinates u, from -1 to 1 across the view, of shown map to
+ * u * k + b on the screen of target. */
+static void similarity(const View *from, const View *to, double *k, double *bx,
+                       double *by) {
+  *k = to->scale / from->scale;
+  *bx = (from->x - to->x) * to->scale / 2.0;
+  *by = (from->y - to->y) * to->scale / 2.0;
+}
+
+char zoomStep(View *shown, const View *target, double dt) {
+  double k, bx, by, t, next;
+
+  shown->maxIterations = target->maxIterations;
+  shown->kernel = target->kernel;
+  similarity(shown, target, &k, &bx, &by);
+
+  /* Nothing on screen leads to another set, jump there. */
+  if (!viewSameSet(shown, target) ||
+      (fabs(log(k)) < 1e-3 && fabs(bx) < 1e-3 && fabs(by) < 1e-3)) {
+    *shown = *target;
+    return 1;
+  }
+
+  /* Shrink the transform toward identity around its fixed point, which is
+   * where the user zoomed to. Pure pans have none and slide instead. */
+  t = exp(-dt / ZOOM_TIME);
+  next = pow(k, t);
+
+  if (fabs(k - 1.0) > 1e-9) {
+    bx = bx / (1.0 - k) * (1.0 - next);
+    by = by / (1.0 - k) * (1.0 - next);
+  } else {
+    bx *= t;
+    by *= t;
+  }
+
+  shown->scale = target->scale / next;
+  shown->x = target->x + bx * 2.0 / target->scale;
+  shown->y = target->y + by * 2.0 / target->scale;
+  return 0;
+}
+
+double zoomError(const View *rendered, const View *shown) {
+  double k, bx, by, magnification, uncovered;
+
+  if (rendered->maxIterations != shown->maxIterations ||
+      rendered->kernel != shown->kernel || !viewSameSet(rendered, shown))
+    return INFINITY;
+
+  similarity(shown, rendered, &k, &bx, &by);
+
+  /* The corners of the screen land furthest outside the texture. */
+  magnification = 1.0 / k;
+  uncovered = fmax(fabs(bx) + k, fabs(by) + k) - 1.0;
+
+  return fmax((magnification - 1.0) / (ZOOM_MAX_MAGNIFICATION - 1.0),
+              uncovered / ZOOM_MAX_UNCOVERED);
+}
+
+void zoomTransform(const View *rendered, const View *shown,
+                   float transform[3]) {
+  double k, bx, by;
+
+  similarity(shown, rendered, &k, &bx, &by);
+  transform[0] = k;
+  transform[1] = bx;
+  transform[2] = by;
+}
+
+char zoomCovers(const View *rendered, const View *shown) {
+  double k, bx, by;
+
+  if (rendered->kernel != shown->kernel || !viewSameSet(rendered, shown))
+    return 0;
+
+  similarity(shown, rendered, &k, &bx, &by);
+  return fmax(fabs(bx), fabs(by)) + k <= 1.0 + 1e-9;
+}
@@ -0,0 +1,186 @@
+#include "cases.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <wilk/formula.h>
+#include <wilk/kernel.h>
+
+/* Same views for both kernels, every formula gets one. */
+#define OVERVIEW -0.3, 0.0, 1.0, 200.0
+#define JULIA 0.0, 0.0, 1.0, 300.0
+/* Pixels a few 1e-12 apart, all of the double precision paths. */
+#define DEEP -0.7436438870371587, 0.1318259042053119, 1e10, 4000.0
+
+const GoldenCase goldenCases[] = {
+    {"mandelbrot",
+     {OVERVIEW, KERNEL_ESCAPE_TIME, FORMULA_MANDELBROT, 0, 0.0, 0.0},
+     NULL,
+     NULL},
+    {"ship",
+     {OVERVIEW, KERNEL_ESCAPE_TIME, FORMULA_BURNING_SHIP, 0, 0.0, 0.0},
+     NULL,
+     NULL},
+    {"tricorn",
+     {OVERVIEW, KERNEL_ESCAPE_TIME, FORMULA_TRICORN, 0, 0.0, 0.0},
+     NULL,
+     NULL},
+    {"cubic",
+     {OVERVIEW, KERNEL_ESCAPE_TIME, FORMULA_CUBIC, 0, 0.0, 0.0},
+     NULL,
+     NULL},
+    {"quartic",
+     {OVERVIEW, KERNEL_ESCAPE_TIME, FORMULA_QUARTIC, 0, 0.0, 0.0},
+     NULL,
+     NULL},
+    {"mandelbrot-distance",
+     {OVERVIEW, KERNEL_DISTANCE, FORMULA_MANDELBROT, 0, 0.0, 0.0},
+     NULL,
+     NULL},
+    {"ship-distance",
+     {OVERVIEW, KERNEL_DISTANCE, FORMULA_BURNING_SHIP, 0, 0.0, 0.0},
+     NULL,
+     NULL},
+    {"tricorn-distance",
+     {OVERVIEW, KERNEL_DISTANCE, FORMULA_TRICORN, 0, 0.0, 0.0},
+     NULL,
+     NULL},
+    {"cubic-distance",
+     {OVERVIEW, KERNEL_DISTANCE, FORMULA_CUBIC, 0, 0.0, 0.0},
+     NULL,
+     NULL},
+    {"quartic-distance",
+     {OVERVIEW, KERNEL_DISTANCE, FORMULA_QUARTIC, 0, 0.0, 0.0},
+     NULL,
+     NULL},
+    {"julia",
+     {JULIA, KERNEL_ESCAPE_TIME, FORMULA_MANDELBROT, 1, -0.8, 0.156},
+     NULL,
+     NULL},
+    {"julia-distance",
+     {JULIA, KERNEL_DISTANCE, FORMULA_MANDELBROT, 1, -0.8, 0.156},
+     NULL,
+     NULL},
+    {"deep",
+     {DEEP, KERNEL_ESCAPE_TIME, FORMULA_MANDELBROT, 0, 0.0, 0.0},
+     NULL,
+     NULL},
+    /* A fractional limit runs its last iteration, chunked or not. */
+    {"fractional-limit",
+     {-0.3, 0.0, 1.0, 200.5, KERNEL_ESCAPE_TIME, FORMULA_MANDELBROT, 0, 0.0,
+      0.0},
+     NULL,
+     NULL},
+    /* The custom formula loop, native or interpreted, against the built in
+     * kernels it spells out. */
+    {"custom-mandelbrot",
+     {OVERVIEW, KERNEL_ESCAPE_TIME, FORMULA_CUSTOM, 0, 0.0, 0.0},
+     "z^2 + c",
+     "mandelbrot"},
+    {"custom-ship",
+     {OVERVIEW, KERNEL_ESCAPE_TIME, FORMULA_CUSTOM, 0, 0.0, 0.0},
+     "fold(z)^2 + c",
+     "ship"},
+    {"custom-deep",
+     {DEEP, KERNEL_ESCAPE_TIME, FORMULA_CUSTOM, 0, 0.0, 0.0},
+     "z^2 + c",
+     "deep"},
+};
+
+const unsigned int goldenCount = sizeof(goldenCases) / sizeof(*goldenCases);
+
+char goldenView(const GoldenCase *c, View *view) {
+  *view = c->view;
+  return !c->custom || formulaCompile(c->custom, &view->formula);
+}
+
+uint16_t goldenQuantise(uint32_t kernel, float value) {
+  double stored = kernel == KERNEL_DISTANCE ? round(value * 64.0) : value;
+
+  return stored < 0.0 ? 0 : stored > 65535.0 ? 65535 : (uint16_t)stored;
+}
+
+static void path(const char *name, char *out, size_t size) {
+  snprintf(out, size, "%s/%s.pgm", GOLDEN_DIR, name);
+}
+
+/* PGM rows go top down, the data bottom up like tiles and textures. */
+char goldenLoad(const char *name, uint16_t *data) {
+  unsigned int width, height, max;
+  unsigned char row[GOLDEN_SIZE * 2];
+  char file[256];
+  FILE *fp;
+  char ok;
+
+  path(name, file, sizeof(file));
+  fp = fopen(file, "rb");
+  if (!fp)
+    return 0;
+
+  ok = fscanf(fp, "P5 %u %u %u", &width, &height, &max) == 3 &&
+       fgetc(fp) != EOF && width == GOLDEN_SIZE && height == GOLDEN_SIZE &&
+       max == 65535;
+
+  for (int j = GOLDEN_SIZE - 1; ok && j >= 0; j--) {
+    ok = fread(row, sizeof(row), 1, fp) == 1;
+    for (int i = 0; ok && i < GOLDEN_SIZE; i++)
+      data[j * GOLDEN_SIZE + i] = row[2 * i] << 8 | row[2 * i + 1];
+  }
+
+  fclose(fp);
+  return ok;
+}
+
+char goldenSave(const char *name, const uint16_t *data) {
+  unsigned char row[GOLDEN_SIZE * 2];
+  char file[256];
+  FILE *fp;
+  char ok;
+
+  path(name, file, sizeof(file));
+  fp = fopen(file, "wb");
+  if (!fp)
+    return 0;
+
+  ok = fprintf(fp, "P5\n%d %d\n65535\n", GOLDEN_SIZE, GOLDEN_SIZE) > 0;
+  for (int j = GOLDEN_SIZE - 1; ok && j >= 0; j--) {
+    for (int i = 0; i < GOLDEN_SIZE; i++) {
+      row[2 * i] = data[j * GOLDEN_SIZE + i] >> 8;
+      row[2 * i + 1] = data[j * GOLDEN_SIZE + i] & 0xff;
+    }
+    ok = fwrite(row, sizeof(row), 1, fp) == 1;
+  }
+
+  return fclose(fp) == 0 && ok;
+}
+
+char goldenCompare(const char *label, const GoldenCase *c, const View *view,
+                   const float *data, const Tolerance *tolerance) {
+  static uint16_t golden[GOLDEN_SIZE * GOLDEN_SIZE];
+  const char *name = c->golden ? c->golden : c->name;
+  unsigned int mismatches = 0, allowed;
+  double worst = 0.0;
+
+  if (!goldenLoad(name, golden)) {
+    printf("FAIL %s %s: no golden data %s/%s.pgm\n", label, c->name,
+           GOLDEN_DIR, name);
+    return 0;
+  }
+
+  for (int i = 0; i < GOLDEN_SIZE * GOLDEN_SIZE; i++) {
+    double g = golden[i], d = fabs(goldenQuantise(view->kernel, data[i]) - g);
+
+    if (d > tolerance->absolute + tolerance->relative * g) {
+      mismatches++;
+      worst = fmax(worst, d);
+    }
+  }
+
+  allowed = (unsigned int)(tolerance->mismatches * GOLDEN_SIZE * GOLDEN_SIZE);
+  printf("%s %s %s: %u of %d pixels off", mismatches > allowed ? "FAIL" : "ok",
+         label, c->name, mismatches, GOLDEN_SIZE * GOLDEN_SIZE);
+  if (mismatches)
+    printf(", by up to %.0f", worst);
+  printf(" (%u allowed)\n", allowed);
+  return mismatches <= allowed;
+}
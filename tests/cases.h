@@ -0,0 +1,51 @@
+#ifndef WILK_TESTS_CASES_H
+#define WILK_TESTS_CASES_H
+
+#include <stdint.h>
+#include <wilk/tilestore.h>
+#include <wilk/view.h>
+
+/*
+ * Reference views of the golden image tests. The golden data of a case is
+ * tests/golden/<name>.pgm, a 16 bit PGM of the CPU render at GOLDEN_SIZE
+ * pixels: escape time counts as they are, distances in 1/64 pixel. Update
+ * them with `golden --update` after a change that is meant to alter the
+ * output, and look at them before committing.
+ */
+
+#define GOLDEN_SIZE 48
+#define GOLDEN_DIR "tests/golden"
+
+typedef struct {
+  const char *name;
+  View view;
+  const char *custom; /* formula source, view.formula follows from it */
+  const char *golden; /* golden data of another case, NULL for its own */
+} GoldenCase;
+
+/* How far a render may be off its golden data: a pixel matches within
+ * absolute plus relative times the golden value, both in stored units,
+ * and at most the fraction mismatches of the pixels may not. */
+typedef struct {
+  double absolute, relative, mismatches;
+} Tolerance;
+
+extern const GoldenCase goldenCases[];
+extern const unsigned int goldenCount;
+
+/* Loads the custom formula of the case, if any, and returns its view. */
+char goldenView(const GoldenCase *c, View *view);
+
+/* Stored value of a rendered one. */
+uint16_t goldenQuantise(uint32_t kernel, float value);
+
+char goldenLoad(const char *name, uint16_t *data);
+char goldenSave(const char *name, const uint16_t *data);
+
+/* Compares GOLDEN_SIZE^2 rendered F32 values, bottom row first, with the
+ * golden data of the case. Prints the outcome under label and returns 0 if
+ * the render is off by more than the tolerance. */
+char goldenCompare(const char *label, const GoldenCase *c, const View *view,
+                   const float *data, const Tolerance *tolerance);
+
+#endif
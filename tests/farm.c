@@ -0,0 +1,95 @@
+/*
+ * Render farm test: a coordinator and two worker processes on a unix
+ * socket render a view that is cut into several tiles, with partial ones at
+ * the edges, and the result must match a local render. Escape time counts
+ * travel exactly, see pack.h, but tiles start from their own corner, which
+ * rounds differently and moves a few chaotic boundary pixels.
+ *
+ * The second render uses a custom formula that only the coordinator has
+ * loaded, the workers compile the source that comes with the tiles.
+ */
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wilk/farm.h>
+#include <wilk/formula.h>
+#include <wilk/kernel.h>
+#include <wilk/view.h>
+
+#define WORKERS 2
+#define WIDTH 600
+#define HEIGHT 300
+#define ALLOWED (WIDTH * HEIGHT / 1000)
+
+static float farm[WIDTH * HEIGHT], local[WIDTH * HEIGHT];
+
+/* Renders view on the farm, the workers start before custom is loaded.
+ * Returns 0 on success. */
+static int render(const char *name, View view, const char *custom) {
+  pid_t workers[WORKERS];
+  char address[64];
+  size_t mismatches = 0;
+  TileKey key;
+  char ok;
+
+  snprintf(address, sizeof(address), "unix:/tmp/wilk-farm-test-%d.sock",
+           (int)getpid());
+
+  /* Workers retry until the coordinator listens. */
+  for (int i = 0; i < WORKERS; i++) {
+    workers[i] = fork();
+    if (workers[i] < 0)
+      return 1;
+    if (!workers[i])
+      _exit(farmWork(address) ? 0 : 1);
+  }
+
+  ok = !custom || formulaCompile(custom, &view.formula);
+  viewTileKey(&view, WIDTH, HEIGHT, TILE_FORMAT_F32, &key);
+  ok = ok && farmCoordinate(address, &key, farm);
+
+  for (int i = 0; i < WORKERS; i++) {
+    int status;
+
+    if (!ok)
+      kill(workers[i], SIGTERM);
+    if (waitpid(workers[i], &status, 0) != workers[i] ||
+        (ok && (!WIFEXITED(status) || WEXITSTATUS(status)))) {
+      printf("FAIL %s: worker %d did not finish cleanly\n", name, i);
+      ok = 0;
+    }
+  }
+
+  if (!ok || !kernelRenderParallel(&key, local, 1)) {
+    printf("FAIL %s: farm render\n", name);
+    return 1;
+  }
+
+  for (size_t i = 0; i < (size_t)WIDTH * HEIGHT; i++)
+    mismatches += farm[i] != local[i];
+
+  printf("%s %s: %zu of %d pixels differ from a local render (%d allowed)\n",
+         mismatches > ALLOWED ? "FAIL" : "ok", name, mismatches,
+         WIDTH * HEIGHT, ALLOWED);
+  return mismatches > ALLOWED;
+}
+
+int main(void) {
+  View view = {-0.745, 0.1, 20.0, 800.0, KERNEL_ESCAPE_TIME,
+               FORMULA_MANDELBROT, 0, 0.0, 0.0};
+  View ship = {-1.75, -0.03, 16.0, 500.0, KERNEL_ESCAPE_TIME,
+               FORMULA_MANDELBROT, 0, 0.0, 0.0};
+  int failures = 0;
+
+  /* A lost worker must fail the test, not hang it. */
+  alarm(120);
+
+  failures += render("farm", view, NULL);
+  failures += render("farm-custom", ship, "fold(z)^2 + c");
+
+  printf("%d failures\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Golden image test of the CPU kernels, see cases.h. Every case is rendered
+ * on one thread and on several, and once more into blocks in Morton order,
+ * with the same expectations. --update writes the golden data of the cases
+ * instead.
+ */
+#include "cases.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wilk/curve.h>
+#include <wilk/kernel.h>
+
+/* The kernels only differ in rounding between compilers and flags, such as
+ * contracted multiply adds, which moves a few boundary pixels. */
+static const Tolerance escapeTime = {0.0, 0.0, 0.002};
+static const Tolerance distance = {2.0, 0.01, 0.005};
+
+static void render(const View *view, unsigned int threads, float *data) {
+  TileKey key;
+
+  viewTileKey(view, GOLDEN_SIZE, GOLDEN_SIZE, TILE_FORMAT_F32, &key);
+  memset(data, 0, GOLDEN_SIZE * GOLDEN_SIZE * sizeof(*data));
+  kernelRenderParallel(&key, data, threads);
+}
+
+/* Blocks stick out of the tile, GOLDEN_SIZE is no multiple of KERNEL_BLOCK. */
+static char renderBlocked(const View *view, float *data) {
+  static float blocked[GOLDEN_SIZE * GOLDEN_SIZE * 4];
+  TileKey key;
+
+  viewTileKey(view, GOLDEN_SIZE, GOLDEN_SIZE, TILE_FORMAT_F32, &key);
+  if ((size_t)kernelBlockCount(&key, NULL) * KERNEL_BLOCK * KERNEL_BLOCK >
+      sizeof(blocked) / sizeof(*blocked))
+    return 0;
+
+  memset(data, 0, GOLDEN_SIZE * GOLDEN_SIZE * sizeof(*data));
+  return kernelRenderBlocks(&key, blocked, 4, CURVE_MORTON, 1) &&
+         kernelUnblock(&key, CURVE_MORTON, blocked, data);
+}
+
+static char update(void) {
+  static float data[GOLDEN_SIZE * GOLDEN_SIZE];
+  static uint16_t stored[GOLDEN_SIZE * GOLDEN_SIZE];
+  char ok = 1;
+
+  for (unsigned int i = 0; i < goldenCount; i++) {
+    const GoldenCase *c = &goldenCases[i];
+    View view;
+
+    /* Cases standing in for another one have nothing to store. */
+    if (c->golden)
+      continue;
+
+    if (!goldenView(c, &view)) {
+      ok = 0;
+      continue;
+    }
+
+    render(&view, 1, data);
+    for (int p = 0; p < GOLDEN_SIZE * GOLDEN_SIZE; p++)
+      stored[p] = goldenQuantise(view.kernel, data[p]);
+
+    if (goldenSave(c->name, stored)) {
+      printf("Wrote %s/%s.pgm\n", GOLDEN_DIR, c->name);
+    } else {
+      fprintf(stderr, "Unable to write %s/%s.pgm\n", GOLDEN_DIR, c->name);
+      ok = 0;
+    }
+  }
+
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  static float data[GOLDEN_SIZE * GOLDEN_SIZE];
+  unsigned int failures = 0;
+
+  if (argc == 2 && strcmp(argv[1], "--update") == 0)
+    return update() ? 0 : 1;
+
+  if (argc != 1) {
+    fprintf(stderr, "Usage: %s [--update]\n", argv[0]);
+    return 1;
+  }
+
+  for (unsigned int i = 0; i < goldenCount; i++) {
+    const GoldenCase *c = &goldenCases[i];
+    const Tolerance *tolerance =
+        c->view.kernel == KERNEL_DISTANCE ? &distance : &escapeTime;
+    View view;
+
+    if (!goldenView(c, &view)) {
+      printf("FAIL %s: bad formula %s\n", c->name, c->custom);
+      failures++;
+      continue;
+    }
+
+    render(&view, 1, data);
+    failures += !goldenCompare("cpu", c, &view, data, tolerance);
+    render(&view, 4, data);
+    failures += !goldenCompare("cpu-threads", c, &view, data, tolerance);
+    failures += !renderBlocked(&view, data) ||
+                !goldenCompare("cpu-blocked", c, &view, data, tolerance);
+  }
+
+  printf("%u failures\n", failures);
+  return failures ? 1 : 0;
+}
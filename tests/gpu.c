@@ -0,0 +1,115 @@
+/*
+ * Golden image test of the GPU kernels, see cases.h: wilk.frag in one pass
+ * and chunk.comp in chunks when there are compute shaders. Both iterate in
+ * double precision like the CPU. Exits with 77, which meson counts as
+ * skipped, when there is no display or GL 4.
+ */
+#include "cases.h"
+
+#include <stdio.h>
+#include <wilk/formula.h>
+#include <wilk/kernel.h>
+#include <wilk/renderer.h>
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#define SKIP 77
+
+/* Drivers are free to fuse and reorder double operations. */
+static const Tolerance escapeTime = {0.0, 0.0, 0.01};
+static const Tolerance distance = {4.0, 0.02, 0.02};
+
+static GLFWwindow *createContext(void) {
+  GLFWwindow *window;
+
+  if (!glfwInit())
+    return NULL;
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+  window = glfwCreateWindow(64, 64, "Wilk test", NULL, NULL);
+  if (!window) {
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+    window = glfwCreateWindow(64, 64, "Wilk test", NULL, NULL);
+  }
+
+  if (window) {
+    glfwMakeContextCurrent(window);
+    gladLoadGL(glfwGetProcAddress);
+  }
+
+  return window;
+}
+
+static void render(Renderer *renderer, const View *view, float *data) {
+  rendererResize(renderer, GOLDEN_SIZE, GOLDEN_SIZE);
+  rendererIterate(renderer, view);
+
+  glBindTexture(GL_TEXTURE_2D, renderer->target);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, data);
+}
+
+int main(void) {
+  static float data[GOLDEN_SIZE * GOLDEN_SIZE];
+  const uint32_t chunks[] = {0, RENDERER_CHUNK, 64};
+  const char *labels[] = {"gpu", "gpu-chunked", "gpu-small-chunks"};
+  Renderer renderer = {0};
+  unsigned int failures = 0;
+  GLFWwindow *window;
+
+  window = createContext();
+  if (!window) {
+    puts("SKIP no GL 4 context");
+    glfwTerminate();
+    return SKIP;
+  }
+
+  if (!rendererInit(&renderer, NULL)) {
+    puts("FAIL shaders do not build");
+    glfwTerminate();
+    return 1;
+  }
+
+  for (unsigned int i = 0; i < goldenCount; i++) {
+    const GoldenCase *c = &goldenCases[i];
+    const Tolerance *tolerance =
+        c->view.kernel == KERNEL_DISTANCE ? &distance : &escapeTime;
+    View view;
+
+    if (!goldenView(c, &view)) {
+      printf("FAIL %s: bad formula %s\n", c->name, c->custom);
+      failures++;
+      continue;
+    }
+
+    /* The custom program of a share group is built once, a new custom
+     * formula needs a new renderer. */
+    if (c->custom) {
+      rendererDestroy(&renderer);
+      if (!rendererInit(&renderer, NULL)) {
+        puts("FAIL shaders do not build");
+        glfwTerminate();
+        return 1;
+      }
+    }
+
+    for (int k = 0; k < 3; k++) {
+      if (k && !renderer.chunked)
+        break;
+
+      renderer.chunkIterations = chunks[k];
+      render(&renderer, &view, data);
+      failures += !goldenCompare(labels[k], c, &view, data, tolerance);
+    }
+  }
+
+  rendererDestroy(&renderer);
+  glfwTerminate();
+
+  printf("%u failures\n", failures);
+  return failures ? 1 : 0;
+}
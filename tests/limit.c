@@ -0,0 +1,73 @@
+/*
+ * Unit test of the iteration limit feedback, see limit.h, on hand made
+ * histograms.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <wilk/histogram.h>
+#include <wilk/limit.h>
+
+#define PIXELS 10000
+
+static uint32_t bins[HISTOGRAM_BINS];
+static unsigned int failures;
+
+/* Feeds the histogram for a frame at maxIterations and checks which way
+ * the limit of the next frame at the same scale moved. */
+static void expect(const char *name, double maxIterations, int direction) {
+  IterationLimit limit = {0.0};
+  double scale = 1024.0, next;
+  char changed;
+
+  changed = limitFeedback(&limit, bins, maxIterations, scale);
+  next = limitFor(&limit, scale);
+
+  if (changed != (direction != 0) ||
+      (direction > 0 && next <= maxIterations) ||
+      (direction < 0 && next >= maxIterations)) {
+    printf("FAIL %s: %g -> %g, changed %d\n", name, maxIterations, next,
+           changed);
+    failures++;
+  } else {
+    printf("ok %s: %g -> %g\n", name, maxIterations, next);
+  }
+}
+
+int main(void) {
+  /* Deep inside the set, nothing escapes. */
+  memset(bins, 0, sizeof(bins));
+  bins[HISTOGRAM_BINS - 1] = PIXELS;
+  expect("all-capped", 600.0, 1);
+
+  /* Mostly capped, the rest escapes early, none near the cap. */
+  memset(bins, 0, sizeof(bins));
+  bins[HISTOGRAM_BINS - 1] = PIXELS * 9 / 10;
+  bins[10] = PIXELS / 10;
+  expect("mostly-capped", 600.0, 1);
+
+  /* A few capped pixels and everything else escaping far below. */
+  memset(bins, 0, sizeof(bins));
+  bins[HISTOGRAM_BINS - 1] = PIXELS / 100;
+  bins[100] = PIXELS - PIXELS / 100;
+  expect("empty-near-cap", 600.0, -1);
+
+  /* Escapes right below the cap. */
+  memset(bins, 0, sizeof(bins));
+  bins[HISTOGRAM_BINS - 1] = PIXELS / 10;
+  bins[HISTOGRAM_BINS - 2] = PIXELS / 10;
+  bins[100] = PIXELS * 8 / 10;
+  expect("near-cap", 600.0, 1);
+
+  /* Nothing capped and escapes over the whole range, about right. */
+  memset(bins, 0, sizeof(bins));
+  for (int i = 0; i < HISTOGRAM_BINS - 1; i += 64)
+    bins[i] = PIXELS / (HISTOGRAM_BINS / 64);
+  expect("spread", 600.0, 0);
+
+  /* An empty frame teaches nothing. */
+  memset(bins, 0, sizeof(bins));
+  expect("empty", 600.0, 0);
+
+  printf("%u failures\n", failures);
+  return failures ? 1 : 0;
+}
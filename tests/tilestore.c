@@ -0,0 +1,126 @@
+/*
+ * Tile store test: several processes put and get tiles in one store with
+ * a small capacity, which must stay bounded. Eviction goes oldest first,
+ * so what is left of each writer are its last tiles.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wilk/tilestore.h>
+
+#define WRITERS 4
+#define PUTS 200
+#define TILE_BYTES 4000
+#define CAPACITY (256 << 10)
+
+static TileKey keyOf(int writer, int i) {
+  TileKey key;
+
+  memset(&key, 0, sizeof(key));
+  key.x = writer;
+  key.y = i;
+  key.width = key.height = 64;
+  key.maxIterations = 100.0;
+  key.format = TILE_FORMAT_PACKED;
+  return key;
+}
+
+/* Puts tiles filled with their number and reads every one back. */
+static int writer(const char *path, int index) {
+  static unsigned char data[TILE_BYTES];
+  TileStore *store = tileStoreOpen(path, CAPACITY);
+  int failures = 0;
+
+  if (!store)
+    return 1;
+
+  for (int i = 0; i < PUTS; i++) {
+    TileKey key = keyOf(index, i);
+    Tile tile;
+
+    memset(data, i, sizeof(data));
+    if (!tileStorePut(store, &key, data, sizeof(data)))
+      failures++;
+
+    /* Another writer may have evicted it already, but never garbled it. */
+    if (tileStoreGet(store, &key, &tile)) {
+      failures += tile.size != sizeof(data) ||
+                  ((const unsigned char *)tile.data)[TILE_BYTES - 1] !=
+                      (unsigned char)i;
+      tileStoreRelease(&tile);
+    }
+  }
+
+  tileStoreClose(store);
+  return failures ? 1 : 0;
+}
+
+int main(void) {
+  char path[64], command[96];
+  unsigned int failures = 0;
+  size_t count, found = 0, gaps = 0;
+  TileStore *store;
+
+  snprintf(path, sizeof(path), "/tmp/wilk-store-test-%d", (int)getpid());
+
+  for (int i = 0; i < WRITERS; i++) {
+    pid_t pid = fork();
+
+    if (pid < 0)
+      return 1;
+    if (!pid)
+      _exit(writer(path, i));
+  }
+
+  for (int i = 0; i < WRITERS; i++) {
+    int status;
+
+    if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+      printf("FAIL writer did not finish cleanly\n");
+      failures++;
+    }
+  }
+
+  store = tileStoreOpen(path, CAPACITY);
+  if (!store)
+    return 1;
+
+  count = tileStoreCount(store);
+  for (int w = 0; w < WRITERS; w++) {
+    char kept = 0;
+
+    for (int i = 0; i < PUTS; i++) {
+      TileKey key = keyOf(w, i);
+      Tile tile;
+
+      if (tileStoreGet(store, &key, &tile)) {
+        found++;
+        kept = 1;
+        tileStoreRelease(&tile);
+      } else {
+        gaps += kept;
+      }
+    }
+  }
+  tileStoreClose(store);
+
+  /* Every tile file costs its data and a header of at most 128 bytes. */
+  if (found != count || count * (TILE_BYTES + 128) > CAPACITY || gaps) {
+    printf("FAIL %zu tiles indexed, %zu found, %zu gaps\n", count, found,
+           gaps);
+    failures++;
+  } else {
+    printf("ok %zu of %d tiles kept within %d bytes\n", count,
+           WRITERS * PUTS, CAPACITY);
+  }
+
+  snprintf(command, sizeof(command), "rm -rf %s", path);
+  if (system(command) != 0)
+    return 1;
+
+  printf("%u failures\n", failures);
+  return failures ? 1 : 0;
+}